@@ -0,0 +1,54 @@
+#include "button_event_queue.h"
+
+#define BUTTON_EVENT_QUEUE_MASK (BUTTON_EVENT_QUEUE_CAPACITY - 1)
+
+_Static_assert((BUTTON_EVENT_QUEUE_CAPACITY & BUTTON_EVENT_QUEUE_MASK) == 0,
+               "BUTTON_EVENT_QUEUE_CAPACITY must be a power of two");
+
+void ButtonEventQueue_Init(ButtonEventQueue *queue)
+{
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->overruns, 0);
+}
+
+bool ButtonEventQueue_Push(ButtonEventQueue *queue, ButtonEvent_Input input,
+                           const struct timespec *timestamp)
+{
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (head - tail >= BUTTON_EVENT_QUEUE_CAPACITY) {
+        atomic_fetch_add_explicit(&queue->overruns, 1, memory_order_relaxed);
+        return false;
+    }
+
+    ButtonEvent *slot = &queue->events[head & BUTTON_EVENT_QUEUE_MASK];
+    slot->timestamp = *timestamp;
+    slot->input = input;
+
+    // Publish the slot contents before making the new head visible to the consumer.
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool ButtonEventQueue_Pop(ButtonEventQueue *queue, ButtonEvent *outEvent)
+{
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    if (tail == head) {
+        return false;
+    }
+
+    *outEvent = queue->events[tail & BUTTON_EVENT_QUEUE_MASK];
+
+    // Release the slot back to the producer only once it has been copied out.
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+uint32_t ButtonEventQueue_TakeOverruns(ButtonEventQueue *queue)
+{
+    return atomic_exchange_explicit(&queue->overruns, 0, memory_order_relaxed);
+}
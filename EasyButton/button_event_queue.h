@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/// <summary>
+///     Capacity of a ButtonEventQueue. Must be a power of two.
+/// </summary>
+#define BUTTON_EVENT_QUEUE_CAPACITY 64
+
+/// <summary>
+///     Enumeration of the inputs that can generate button events.
+/// </summary>
+typedef enum {
+    ButtonEvent_Input_ButtonA = 0,
+    ButtonEvent_Input_ButtonB = 1,
+    ButtonEvent_Input_EasyButton = 2
+} ButtonEvent_Input;
+
+/// <summary>
+///     A single button press, captured at the time the edge was detected.
+/// </summary>
+typedef struct ButtonEvent {
+    /// <summary>
+    ///     CLOCK_MONOTONIC time at which the press was detected.
+    /// </summary>
+    struct timespec timestamp;
+    /// <summary>
+    ///     The input that was pressed.
+    /// </summary>
+    ButtonEvent_Input input;
+} ButtonEvent;
+
+/// <summary>
+///     Fixed-size, lock-free, single-producer single-consumer ring of button events.
+///     The producer only writes 'head' and the consumer only writes 'tail', so pushing never
+///     blocks on the consumer and the consumer can run in a separate handler or thread.
+/// </summary>
+typedef struct ButtonEventQueue {
+    ButtonEvent events[BUTTON_EVENT_QUEUE_CAPACITY];
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    /// <summary>
+    ///     Number of events dropped because the queue was full.
+    /// </summary>
+    _Atomic uint32_t overruns;
+} ButtonEventQueue;
+
+/// <summary>
+///     Resets a queue to the empty state.
+/// </summary>
+/// <param name="queue">The queue to reset.</param>
+void ButtonEventQueue_Init(ButtonEventQueue *queue);
+
+/// <summary>
+///     Adds an event to the queue. Must only be called from the producer.
+/// </summary>
+/// <param name="queue">The queue.</param>
+/// <param name="input">The input that was pressed.</param>
+/// <param name="timestamp">CLOCK_MONOTONIC time at which the press was detected.</param>
+/// <returns>true if the event was queued, false if the queue was full.</returns>
+bool ButtonEventQueue_Push(ButtonEventQueue *queue, ButtonEvent_Input input,
+                           const struct timespec *timestamp);
+
+/// <summary>
+///     Removes the oldest event from the queue. Must only be called from the consumer.
+/// </summary>
+/// <param name="queue">The queue.</param>
+/// <param name="outEvent">Receives the removed event.</param>
+/// <returns>true if an event was removed, false if the queue was empty.</returns>
+bool ButtonEventQueue_Pop(ButtonEventQueue *queue, ButtonEvent *outEvent);
+
+/// <summary>
+///     Returns and clears the number of events dropped since the last call.
+/// </summary>
+/// <param name="queue">The queue.</param>
+/// <returns>The number of dropped events.</returns>
+uint32_t ButtonEventQueue_TakeOverruns(ButtonEventQueue *queue);
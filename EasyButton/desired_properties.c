@@ -0,0 +1,190 @@
+#include <string.h>
+
+#include <applibs/log.h>
+
+#include "desired_properties.h"
+
+static const DesiredProperties_Property *registeredProperties = NULL;
+static size_t registeredPropertyCount = 0;
+
+// Indices of the properties, sorted by the hash of their name.
+static uint8_t sortedProperties[DESIRED_PROPERTIES_MAX];
+
+// Copy of the value last applied for each property, or NULL if none was.
+static JSON_Value *appliedValues[DESIRED_PROPERTIES_MAX];
+// "$version" of the last update processed, 0 if none was.
+static double appliedVersion = 0;
+
+/// <summary>
+///     32-bit FNV-1a hash of a string.
+/// </summary>
+static uint32_t Hash(const char *string)
+{
+    uint32_t hash = 2166136261u;
+    for (; *string != '\0'; string++) {
+        hash = (hash ^ (uint8_t)*string) * 16777619u;
+    }
+    return hash;
+}
+
+int DesiredProperties_Init(const DesiredProperties_Property *properties, size_t propertyCount)
+{
+    if (propertyCount > DESIRED_PROPERTIES_MAX) {
+        Log_Debug("ERROR: Cannot handle more than %d desired properties.\n",
+                  DESIRED_PROPERTIES_MAX);
+        return -1;
+    }
+
+    for (size_t i = 0; i < propertyCount; i++) {
+        uint32_t hash = Hash(properties[i].name);
+        if (hash != properties[i].nameHash) {
+            Log_Debug("ERROR: Desired property \"%s\" has hash 0x%08x, not 0x%08x.\n",
+                      properties[i].name, hash, properties[i].nameHash);
+            return -1;
+        }
+
+        // Insertion sort by hash; the table is small and sorted once.
+        size_t position = i;
+        while (position > 0 && properties[sortedProperties[position - 1]].nameHash > hash) {
+            sortedProperties[position] = sortedProperties[position - 1];
+            position--;
+        }
+        if (position > 0 && properties[sortedProperties[position - 1]].nameHash == hash) {
+            Log_Debug("ERROR: Desired properties \"%s\" and \"%s\" have the same hash.\n",
+                      properties[i].name, properties[sortedProperties[position - 1]].name);
+            return -1;
+        }
+        sortedProperties[position] = (uint8_t)i;
+    }
+
+    registeredProperties = properties;
+    registeredPropertyCount = propertyCount;
+    appliedVersion = 0;
+    for (size_t i = 0; i < propertyCount; i++) {
+        appliedValues[i] = NULL;
+    }
+    return 0;
+}
+
+/// <summary>
+///     Finds the property with the given name.
+/// </summary>
+/// <returns>The index of the property, or -1 if the name is not registered.</returns>
+static int FindProperty(const char *name)
+{
+    uint32_t hash = Hash(name);
+    size_t low = 0;
+    size_t high = registeredPropertyCount;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        uint32_t middleHash = registeredProperties[sortedProperties[middle]].nameHash;
+        if (middleHash < hash) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low == registeredPropertyCount ||
+        registeredProperties[sortedProperties[low]].nameHash != hash ||
+        strcmp(registeredProperties[sortedProperties[low]].name, name) != 0) {
+        return -1;
+    }
+    return sortedProperties[low];
+}
+
+/// <summary>
+///     Decodes the value of a property against its declared type and range.
+/// </summary>
+/// <returns>true if the value is valid, false otherwise.</returns>
+static bool DecodeValue(const DesiredProperties_Property *property, const JSON_Value *json,
+                        DesiredProperties_Value *value)
+{
+    memset(value, 0, sizeof(*value));
+    switch (property->type) {
+    case DesiredProperties_Type_Number:
+        if (json_value_get_type(json) != JSONNumber) {
+            return false;
+        }
+        value->number = json_value_get_number(json);
+        return value->number >= property->minimum && value->number <= property->maximum;
+    case DesiredProperties_Type_Boolean:
+        if (json_value_get_type(json) != JSONBoolean) {
+            return false;
+        }
+        value->boolean = json_value_get_boolean(json) == 1;
+        return true;
+    case DesiredProperties_Type_String:
+        value->string = json_value_get_string(json);
+        return value->string != NULL;
+    }
+    return false;
+}
+
+/// <summary>
+///     Applies the value of a property if it differs from the value last applied.
+/// </summary>
+static void ApplyProperty(size_t index, const JSON_Value *json)
+{
+    if (appliedValues[index] != NULL && json_value_equals(appliedValues[index], json)) {
+        return;
+    }
+
+    const DesiredProperties_Property *property = &registeredProperties[index];
+    DesiredProperties_Value value;
+    if (!DecodeValue(property, json, &value)) {
+        Log_Debug("INFO: Device twin desired property \"%s\" was received with an incorrect "
+                  "type or out of range.\n",
+                  property->name);
+        return;
+    }
+
+    JSON_Value *copy = json_value_deep_copy(json);
+    if (copy == NULL) {
+        Log_Debug("ERROR: Could not copy desired property \"%s\".\n", property->name);
+        return;
+    }
+    json_value_free(appliedValues[index]);
+    appliedValues[index] = copy;
+
+    property->handler(&value);
+}
+
+void DesiredProperties_Update(const JSON_Object *desiredProperties)
+{
+    // The desired properties of a full document are nested in it; those of a delta are its root.
+    bool isFullDocument =
+        json_value_get_parent(json_object_get_wrapping_value(desiredProperties)) != NULL;
+
+    const JSON_Value *versionJson = json_object_get_value(desiredProperties, "$version");
+    if (versionJson != NULL && json_value_get_type(versionJson) == JSONNumber) {
+        double version = json_value_get_number(versionJson);
+        if (!isFullDocument && version <= appliedVersion) {
+            Log_Debug("INFO: Dropping device twin update of version %.0f; version %.0f is "
+                      "applied.\n",
+                      version, appliedVersion);
+            return;
+        }
+        if (version < appliedVersion) {
+            Log_Debug("INFO: Device twin version restarted at %.0f after version %.0f.\n",
+                      version, appliedVersion);
+        }
+        appliedVersion = version;
+    }
+
+    size_t memberCount = json_object_get_count(desiredProperties);
+    for (size_t i = 0; i < memberCount; i++) {
+        int index = FindProperty(json_object_get_name(desiredProperties, i));
+        if (index >= 0) {
+            ApplyProperty((size_t)index, json_object_get_value_at(desiredProperties, i));
+        }
+    }
+}
+
+void DesiredProperties_Close(void)
+{
+    for (size_t i = 0; i < registeredPropertyCount; i++) {
+        json_value_free(appliedValues[i]);
+        appliedValues[i] = NULL;
+    }
+}
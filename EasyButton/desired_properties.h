@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parson.h"
+
+/// <summary>
+///     Maximum number of desired properties.
+/// </summary>
+#define DESIRED_PROPERTIES_MAX 32
+
+/// <summary>
+///     Types of desired property values.
+/// </summary>
+typedef enum {
+    DesiredProperties_Type_Number = 0,
+    DesiredProperties_Type_Boolean,
+    DesiredProperties_Type_String
+} DesiredProperties_Type;
+
+/// <summary>
+///     The value of a desired property, of the type declared for it.
+/// </summary>
+typedef struct DesiredProperties_Value {
+    double number;
+    bool boolean;
+    /// <summary>Only valid during the call to the handler.</summary>
+    const char *string;
+} DesiredProperties_Value;
+
+/// <summary>
+///     Handler of a desired property, called when its value changes.
+/// </summary>
+/// <param name="value">The new value of the property.</param>
+typedef void (*DesiredProperties_Handler)(const DesiredProperties_Value *value);
+
+/// <summary>
+///     A desired property of the device twin: its name, the type and range of its values, and
+///     its handler.
+/// </summary>
+typedef struct DesiredProperties_Property {
+    const char *name;
+    /// <summary>
+    ///     32-bit FNV-1a hash of the name, computed when the table is written; checked by
+    ///     DesiredProperties_Init.
+    /// </summary>
+    uint32_t nameHash;
+    DesiredProperties_Type type;
+    /// <summary>Range of the values of a number property; other values are rejected.</summary>
+    double minimum;
+    double maximum;
+    DesiredProperties_Handler handler;
+} DesiredProperties_Property;
+
+/// <summary>
+///     Registers the desired properties handled by the application, and checks the hash of
+///     their names.
+/// </summary>
+/// <param name="properties">The properties; the array must outlive the registry.</param>
+/// <param name="propertyCount">The number of properties.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int DesiredProperties_Init(const DesiredProperties_Property *properties, size_t propertyCount);
+
+/// <summary>
+///     Processes the desired properties of a device twin update, either a delta or a full
+///     document, in one pass over its members. Deltas whose "$version" is not newer than the
+///     last one processed are dropped. A full document is always processed, since its version
+///     starts over when the twin is recreated. Only the handlers of the properties whose value
+///     differs from the value they last applied are called.
+/// </summary>
+/// <param name="desiredProperties">The desired properties of the update: the root of a delta,
+/// or the "desired" member of a full document.</param>
+void DesiredProperties_Update(const JSON_Object *desiredProperties);
+
+/// <summary>
+///     Releases the last applied values.
+/// </summary>
+void DesiredProperties_Close(void);
@@ -0,0 +1,178 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <applibs/log.h>
+
+#include "direct_method.h"
+#include "parson.h"
+
+// A power of two, sparse enough that a seed mapping every name to its own slot is found in a
+// few dozen attempts even with the maximum number of methods.
+#define TABLE_SIZE (8 * DIRECT_METHOD_MAX_METHODS)
+
+// Number of hash seeds tried to find one without collisions.
+#define MAX_SEED_ATTEMPTS 1024
+
+static const DirectMethodResponse_Template noMethodFoundResponse =
+    DIRECT_METHOD_RESPONSE_TEMPLATE("\"method not found '", "'\"");
+
+// Index + 1 of the method of each slot, selected by the hash of its name; 0 for empty slots.
+static uint8_t methodSlots[TABLE_SIZE];
+static const DirectMethod_Registration *registeredMethods = NULL;
+static uint32_t hashSeed = 0;
+
+/// <summary>
+///     Seeded FNV-1a hash of a string.
+/// </summary>
+static uint32_t Hash(uint32_t seed, const char *string)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for (; *string != '\0'; string++) {
+        hash = (hash ^ (uint8_t)*string) * 16777619u;
+    }
+    return hash;
+}
+
+int DirectMethod_Init(const DirectMethod_Registration *methods, size_t methodCount)
+{
+    if (methodCount > DIRECT_METHOD_MAX_METHODS) {
+        Log_Debug("ERROR: Cannot register more than %d direct methods.\n",
+                  DIRECT_METHOD_MAX_METHODS);
+        return -1;
+    }
+
+    for (size_t i = 0; i < methodCount; i++) {
+        if (methods[i].fieldCount > DIRECT_METHOD_MAX_FIELDS) {
+            Log_Debug("ERROR: Direct method '%s' has more than %d fields.\n", methods[i].name,
+                      DIRECT_METHOD_MAX_FIELDS);
+            return -1;
+        }
+    }
+
+    // Look for a seed that maps every name to its own slot.
+    registeredMethods = methods;
+    for (uint32_t seed = 0; seed < MAX_SEED_ATTEMPTS; seed++) {
+        memset(methodSlots, 0, sizeof(methodSlots));
+        size_t placed = 0;
+        uint32_t slot = 0;
+        while (placed < methodCount) {
+            slot = Hash(seed, methods[placed].name) & (TABLE_SIZE - 1);
+            if (methodSlots[slot] != 0) {
+                break;
+            }
+            methodSlots[slot] = (uint8_t)(placed + 1);
+            placed++;
+        }
+
+        if (placed == methodCount) {
+            hashSeed = seed;
+            return 0;
+        }
+
+        if (strcmp(methods[methodSlots[slot] - 1].name, methods[placed].name) == 0) {
+            Log_Debug("ERROR: Direct method '%s' is registered twice.\n", methods[placed].name);
+            break;
+        }
+    }
+
+    memset(methodSlots, 0, sizeof(methodSlots));
+    Log_Debug("ERROR: Could not build the direct method table.\n");
+    return -1;
+}
+
+/// <summary>
+///     Decodes a JSON payload against the fields of a method.
+/// </summary>
+/// <returns>true if the payload is an object matching the fields, false otherwise.</returns>
+static bool DecodePayload(const DirectMethod_Registration *method, const JSON_Value *payloadJson,
+                          DirectMethod_Value *values)
+{
+    const JSON_Object *payloadObject = json_value_get_object(payloadJson);
+    if (payloadObject == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < method->fieldCount; i++) {
+        const DirectMethod_Field *field = &method->fields[i];
+        const JSON_Value *fieldJson = json_object_get_value(payloadObject, field->name);
+        memset(&values[i], 0, sizeof(values[i]));
+
+        if (fieldJson == NULL) {
+            if (field->required) {
+                return false;
+            }
+            continue;
+        }
+
+        switch (field->type) {
+        case DirectMethod_FieldType_String:
+            values[i].string = json_value_get_string(fieldJson);
+            if (values[i].string == NULL) {
+                return false;
+            }
+            values[i].stringLength = strlen(values[i].string);
+            break;
+        case DirectMethod_FieldType_Number:
+            if (json_value_get_type(fieldJson) != JSONNumber) {
+                return false;
+            }
+            values[i].number = json_value_get_number(fieldJson);
+            break;
+        case DirectMethod_FieldType_Boolean:
+            if (json_value_get_type(fieldJson) != JSONBoolean) {
+                return false;
+            }
+            values[i].boolean = json_value_get_boolean(fieldJson) == 1;
+            break;
+        }
+        values[i].isPresent = true;
+    }
+
+    return true;
+}
+
+int DirectMethod_Dispatch(const char *methodName, const char *payload, size_t payloadSize,
+                          char **responsePayload, size_t *responsePayloadSize)
+{
+    *responsePayload = NULL;
+    *responsePayloadSize = 0;
+
+    uint8_t methodSlot = methodSlots[Hash(hashSeed, methodName) & (TABLE_SIZE - 1)];
+    const DirectMethod_Registration *method =
+        methodSlot == 0 ? NULL : &registeredMethods[methodSlot - 1];
+    if (method == NULL || strcmp(method->name, methodName) != 0) {
+        Log_Debug("INFO: Method not found called: '%s'.\n", methodName);
+        DirectMethod_Respond(&noMethodFoundResponse, methodName, responsePayload,
+                             responsePayloadSize);
+        return 404;
+    }
+
+    // The payload is not null terminated; it is parsed in place.
+    JSON_Value *payloadJson = json_parse_stringn(payload, payloadSize);
+
+    int result;
+    DirectMethod_Value values[DIRECT_METHOD_MAX_FIELDS];
+    if (payloadJson != NULL && DecodePayload(method, payloadJson, values)) {
+        result = method->handler(values, responsePayload, responsePayloadSize);
+    } else {
+        Log_Debug("INFO: Unrecognised direct method payload format.\n");
+        DirectMethod_Respond(method->invalidPayloadResponse, NULL, responsePayload,
+                             responsePayloadSize);
+        result = 400; // Bad request.
+    }
+
+    json_value_free(payloadJson);
+    return result;
+}
+
+void DirectMethod_Respond(const DirectMethodResponse_Template *responseTemplate, const char *value,
+                          char **responsePayload, size_t *responsePayloadSize)
+{
+    *responsePayload = DirectMethodResponse_Render(
+        responseTemplate, value, value == NULL ? 0 : strlen(value), responsePayloadSize);
+    if (*responsePayload == NULL) {
+        Log_Debug("ERROR: Could not allocate buffer for direct method response payload.\n");
+        abort();
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "direct_method_response.h"
+
+/// <summary>
+///     Maximum number of registered direct methods.
+/// </summary>
+#define DIRECT_METHOD_MAX_METHODS 64
+
+/// <summary>
+///     Maximum number of payload fields of a direct method.
+/// </summary>
+#define DIRECT_METHOD_MAX_FIELDS 8
+
+/// <summary>
+///     Types of the payload fields of a direct method.
+/// </summary>
+typedef enum {
+    DirectMethod_FieldType_String = 0,
+    DirectMethod_FieldType_Number,
+    DirectMethod_FieldType_Boolean
+} DirectMethod_FieldType;
+
+/// <summary>
+///     A field of the JSON object payload accepted by a direct method.
+/// </summary>
+typedef struct DirectMethod_Field {
+    const char *name;
+    DirectMethod_FieldType type;
+    /// <summary>If set, calls without the field are rejected before reaching the handler.</summary>
+    bool required;
+} DirectMethod_Field;
+
+/// <summary>
+///     The decoded value of a payload field, valid until the handler returns.
+/// </summary>
+typedef struct DirectMethod_Value {
+    /// <summary>false if the field is optional and absent from the payload.</summary>
+    bool isPresent;
+    const char *string;
+    size_t stringLength;
+    double number;
+    bool boolean;
+} DirectMethod_Value;
+
+/// <summary>
+///     Handler of a direct method.
+/// </summary>
+/// <param name="values">The decoded payload, one value per field of the method, in the order
+/// of its fields.</param>
+/// <param name="responsePayload">Receives the response, heap allocated; see
+/// DirectMethod_Respond.</param>
+/// <param name="responsePayloadSize">Receives the size of the response.</param>
+/// <returns>The HTTP status code of the call.</returns>
+typedef int (*DirectMethod_Handler)(const DirectMethod_Value *values, char **responsePayload,
+                                    size_t *responsePayloadSize);
+
+/// <summary>
+///     A direct method: its name, the payload it accepts and its handler.
+/// </summary>
+typedef struct DirectMethod_Registration {
+    const char *name;
+    const DirectMethod_Field *fields;
+    size_t fieldCount;
+    DirectMethod_Handler handler;
+    /// <summary>Response of the calls whose payload does not match the fields, with status
+    /// 400.</summary>
+    const DirectMethodResponse_Template *invalidPayloadResponse;
+} DirectMethod_Registration;
+
+/// <summary>
+///     Registers the direct methods, and builds a perfect hash table of their names so that a
+///     call is dispatched with one hash and one string comparison whatever the number of
+///     methods.
+/// </summary>
+/// <param name="methods">The methods; the array must outlive the registry.</param>
+/// <param name="methodCount">The number of methods.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int DirectMethod_Init(const DirectMethod_Registration *methods, size_t methodCount);
+
+/// <summary>
+///     Dispatches a direct method call to its registered handler, after decoding its payload
+///     against the fields of the method. Has the signature of the direct method callback of the
+///     Azure IoT Hub utilities.
+/// </summary>
+/// <param name="methodName">The name of the method being called.</param>
+/// <param name="payload">The payload of the method; it does not need to be null
+/// terminated.</param>
+/// <param name="payloadSize">The size of the payload.</param>
+/// <param name="responsePayload">Receives the response, which the Azure IoT Hub SDK frees.</param>
+/// <param name="responsePayloadSize">Receives the size of the response.</param>
+/// <returns>The status code of the handler; 400 if the payload does not match the fields of
+/// the method; 404 if the method is not registered.</returns>
+int DirectMethod_Dispatch(const char *methodName, const char *payload, size_t payloadSize,
+                          char **responsePayload, size_t *responsePayloadSize);
+
+/// <summary>
+///     Renders the response of a direct method with DirectMethodResponse_Render. Aborts if the
+///     response cannot be allocated.
+/// </summary>
+/// <param name="responseTemplate">The response template.</param>
+/// <param name="value">The null-terminated value inserted into the template, or NULL.</param>
+/// <param name="responsePayload">Receives the response.</param>
+/// <param name="responsePayloadSize">Receives the size of the response.</param>
+void DirectMethod_Respond(const DirectMethodResponse_Template *responseTemplate, const char *value,
+                          char **responsePayload, size_t *responsePayloadSize);
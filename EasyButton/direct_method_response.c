@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "direct_method_response.h"
+
+// Allocation sizes of the responses. Larger responses are allocated at their exact size.
+static const size_t sizeClasses[] = {64, 128, 256, 512};
+static const size_t sizeClassesCount = sizeof(sizeClasses) / sizeof(*sizeClasses);
+
+static size_t RoundUpToSizeClass(size_t size)
+{
+    for (size_t i = 0; i < sizeClassesCount; i++) {
+        if (size <= sizeClasses[i]) {
+            return sizeClasses[i];
+        }
+    }
+    return size;
+}
+
+char *DirectMethodResponse_Render(const DirectMethodResponse_Template *responseTemplate,
+                                  const char *value, size_t valueLength, size_t *outSize)
+{
+    size_t length = responseTemplate->prefixLength + valueLength + responseTemplate->suffixLength;
+    char *response = malloc(RoundUpToSizeClass(length + 1));
+    if (response == NULL) {
+        return NULL;
+    }
+
+    char *position = response;
+    memcpy(position, responseTemplate->prefix, responseTemplate->prefixLength);
+    position += responseTemplate->prefixLength;
+    if (valueLength != 0) {
+        memcpy(position, value, valueLength);
+        position += valueLength;
+    }
+    memcpy(position, responseTemplate->suffix, responseTemplate->suffixLength);
+    position[responseTemplate->suffixLength] = '\0';
+
+    *outSize = length;
+    return response;
+}
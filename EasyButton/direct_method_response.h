@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+
+/// <summary>
+///     A pre-rendered direct method response, with at most one value inserted between its
+///     prefix and its suffix.
+/// </summary>
+typedef struct DirectMethodResponse_Template {
+    const char *prefix;
+    size_t prefixLength;
+    const char *suffix;
+    size_t suffixLength;
+} DirectMethodResponse_Template;
+
+/// <summary>
+///     Initializer of a DirectMethodResponse_Template from two string literals, whose lengths
+///     are computed at compile time.
+/// </summary>
+#define DIRECT_METHOD_RESPONSE_TEMPLATE(prefix, suffix)        \
+    {                                                          \
+        prefix, sizeof(prefix) - 1, suffix, sizeof(suffix) - 1 \
+    }
+
+/// <summary>
+///     Renders a response into a buffer for the Azure IoT Hub SDK, which frees it with 'free'
+///     once the response is sent. The text is copied from the template with no formatting,
+///     and the buffer size is rounded up to one of a few size classes, so that the blocks freed
+///     by the SDK are reused as they are by the next responses instead of fragmenting the heap.
+/// </summary>
+/// <param name="responseTemplate">The response template.</param>
+/// <param name="value">The value inserted between the prefix and the suffix; may be NULL if
+/// 'valueLength' is 0.</param>
+/// <param name="valueLength">The length of the value.</param>
+/// <param name="outSize">Receives the length of the response.</param>
+/// <returns>The null-terminated response, or NULL if it could not be allocated.</returns>
+char *DirectMethodResponse_Render(const DirectMethodResponse_Template *responseTemplate,
+                                  const char *value, size_t valueLength, size_t *outSize);
@@ -0,0 +1,113 @@
+#include <stdint.h>
+
+#include <applibs/log.h>
+
+#include "do_work_scheduler.h"
+#include "epoll_timerfd_utilities.h"
+
+static DoWorkScheduler_Config schedulerConfig;
+static int schedulerTimerFd = -1;
+
+// Expiry of the timer, when it is armed.
+static struct timespec scheduledRun;
+static bool isScheduled = false;
+
+// Period used after an idle run, and whether there was activity since the last run.
+static int64_t idlePeriodNs = 0;
+static bool hadActivity = false;
+
+static int64_t ToNanoseconds(const struct timespec *time)
+{
+    return (int64_t)time->tv_sec * 1000000000LL + time->tv_nsec;
+}
+
+static struct timespec FromNanoseconds(int64_t nanoseconds)
+{
+    struct timespec time = {.tv_sec = (time_t)(nanoseconds / 1000000000LL),
+                            .tv_nsec = (long)(nanoseconds % 1000000000LL)};
+    return time;
+}
+
+static struct timespec Now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now;
+}
+
+int DoWorkScheduler_Init(int timerFd, const DoWorkScheduler_Config *config)
+{
+    if (ToNanoseconds(&config->minIdlePeriod) <= 0 ||
+        ToNanoseconds(&config->maxIdlePeriod) < ToNanoseconds(&config->minIdlePeriod) ||
+        ToNanoseconds(&config->confirmationPeriod) <= 0) {
+        Log_Debug("ERROR: Invalid DoWork periods.\n");
+        return -1;
+    }
+
+    schedulerConfig = *config;
+    schedulerTimerFd = timerFd;
+    idlePeriodNs = ToNanoseconds(&config->minIdlePeriod);
+    hadActivity = false;
+    isScheduled = false;
+
+    struct timespec now = Now();
+    DoWorkScheduler_RequestBy(&now);
+    return isScheduled ? 0 : -1;
+}
+
+void DoWorkScheduler_RequestBy(const struct timespec *deadline)
+{
+    if (isScheduled && ToNanoseconds(&scheduledRun) <= ToNanoseconds(deadline)) {
+        return;
+    }
+
+    // An expiry in the past fires immediately, but a zero one would disarm the timer.
+    struct timespec expiry = *deadline;
+    if (expiry.tv_sec == 0 && expiry.tv_nsec == 0) {
+        expiry.tv_nsec = 1;
+    }
+    if (SetTimerFdToAbsoluteExpiry(schedulerTimerFd, &expiry) != 0) {
+        return;
+    }
+    scheduledRun = expiry;
+    isScheduled = true;
+}
+
+void DoWorkScheduler_RequestNow(void)
+{
+    hadActivity = true;
+    struct timespec now = Now();
+    DoWorkScheduler_RequestBy(&now);
+}
+
+void DoWorkScheduler_NotifyActivity(void)
+{
+    hadActivity = true;
+}
+
+void DoWorkScheduler_BeginRun(void)
+{
+    isScheduled = false;
+}
+
+void DoWorkScheduler_ScheduleNext(bool awaitingConfirmations)
+{
+    int64_t minIdlePeriodNs = ToNanoseconds(&schedulerConfig.minIdlePeriod);
+    int64_t maxIdlePeriodNs = ToNanoseconds(&schedulerConfig.maxIdlePeriod);
+    if (hadActivity) {
+        idlePeriodNs = minIdlePeriodNs;
+    } else if (idlePeriodNs < maxIdlePeriodNs) {
+        idlePeriodNs = idlePeriodNs * 2 < maxIdlePeriodNs ? idlePeriodNs * 2 : maxIdlePeriodNs;
+    }
+    hadActivity = false;
+
+    int64_t periodNs = idlePeriodNs;
+    int64_t confirmationPeriodNs = ToNanoseconds(&schedulerConfig.confirmationPeriod);
+    if (awaitingConfirmations && confirmationPeriodNs < periodNs) {
+        periodNs = confirmationPeriodNs;
+    }
+
+    struct timespec now = Now();
+    struct timespec next = FromNanoseconds(ToNanoseconds(&now) + periodNs);
+    DoWorkScheduler_RequestBy(&next);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <time.h>
+
+/// <summary>
+///     Periods between two runs of the IoT Hub SDK's DoWork.
+/// </summary>
+typedef struct DoWorkScheduler_Config {
+    /// <summary>Period after a run that had activity; it doubles after each idle run.</summary>
+    struct timespec minIdlePeriod;
+    /// <summary>Longest period between two runs.</summary>
+    struct timespec maxIdlePeriod;
+    /// <summary>Longest period between two runs while confirmations are awaited.</summary>
+    struct timespec confirmationPeriod;
+} DoWorkScheduler_Config;
+
+/// <summary>
+///     Initializes the scheduler, which drives a single-expiry timer so that DoWork runs as soon
+///     as there is something to send, often while confirmations are awaited, and less and less
+///     often while the device is idle. The first run is scheduled immediately.
+/// </summary>
+/// <param name="timerFd">The timer whose handler runs DoWork.</param>
+/// <param name="config">The periods between two runs.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int DoWorkScheduler_Init(int timerFd, const DoWorkScheduler_Config *config);
+
+/// <summary>
+///     Schedules a run no later than the given time.
+/// </summary>
+/// <param name="deadline">CLOCK_MONOTONIC time of the run.</param>
+void DoWorkScheduler_RequestBy(const struct timespec *deadline);
+
+/// <summary>
+///     Records activity, which resets the idle period, and schedules a run as soon as possible;
+///     used when something was handed to the SDK.
+/// </summary>
+void DoWorkScheduler_RequestNow(void);
+
+/// <summary>
+///     Records activity, which resets the idle period, without scheduling a run.
+/// </summary>
+void DoWorkScheduler_NotifyActivity(void);
+
+/// <summary>
+///     Marks the start of a run; called once its timer event was consumed.
+/// </summary>
+void DoWorkScheduler_BeginRun(void);
+
+/// <summary>
+///     Schedules the next run; called at the end of each run. A run requested during this one
+///     is kept if it is earlier.
+/// </summary>
+/// <param name="awaitingConfirmations">true if messages are waiting for a confirmation from
+/// the IoT Hub.</param>
+void DoWorkScheduler_ScheduleNext(bool awaitingConfirmations);
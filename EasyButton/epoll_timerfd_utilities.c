@@ -1,6 +1,7 @@
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/eventfd.h>
 #include <sys/timerfd.h>
 #include <applibs/log.h>
 #include "epoll_timerfd_utilities.h"
@@ -79,11 +80,25 @@ int SetTimerFdToSingleExpiry(int timerFd, const struct timespec *expiry)
     return 0;
 }
 
+int SetTimerFdToAbsoluteExpiry(int timerFd, const struct timespec *expiry)
+{
+    struct itimerspec newValue = {.it_value = *expiry, .it_interval = {}};
+
+    if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &newValue, NULL) < 0) {
+        Log_Debug("ERROR: Could not set timerfd expiry: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    return 0;
+}
+
 int ConsumeTimerFdEvent(int timerFd)
 {
     uint64_t timerData = 0;
 
-    if (read(timerFd, &timerData, sizeof(timerData)) == -1) {
+    // EAGAIN means the expiry was already consumed, or the timer re-armed, by a handler that ran
+    // earlier for the same wait.
+    if (read(timerFd, &timerData, sizeof(timerData)) == -1 && errno != EAGAIN) {
         Log_Debug("ERROR: Could not read timerfd %s (%d).\n", strerror(errno), errno);
         return -1;
     }
@@ -116,10 +131,53 @@ int CreateTimerFdAndAddToEpoll(int epollFd, const struct timespec *period,
     return timerFd;
 }
 
+int CreateEventFdAndAddToEpoll(int epollFd, event_data_t *persistentEventData,
+                               const uint32_t epollEventMask)
+{
+    int eventFd = eventfd(0, EFD_NONBLOCK);
+    if (eventFd < 0) {
+        Log_Debug("ERROR: Could not create eventfd: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    if (RegisterEventHandlerToEpoll(epollFd, eventFd, persistentEventData, epollEventMask) != 0) {
+        CloseFdAndPrintError(eventFd, "EventFd");
+        return -1;
+    }
+
+    return eventFd;
+}
+
+int SignalEventFd(int eventFd)
+{
+    uint64_t increment = 1;
+
+    // EAGAIN means the counter is saturated, so the handler is already due to run.
+    if (write(eventFd, &increment, sizeof(increment)) == -1 && errno != EAGAIN) {
+        Log_Debug("ERROR: Could not signal eventfd: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+int ConsumeEventFdEvent(int eventFd)
+{
+    uint64_t eventData = 0;
+
+    // EAGAIN means another handler invocation already consumed the pending signals.
+    if (read(eventFd, &eventData, sizeof(eventData)) == -1 && errno != EAGAIN) {
+        Log_Debug("ERROR: Could not read eventfd %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    return 0;
+}
+
 int WaitForEventAndCallHandler(int epollFd)
 {
-    struct epoll_event event;
-    int numEventsOccurred = epoll_wait(epollFd, &event, 1, -1);
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int numEventsOccurred = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, -1);
 
     if (numEventsOccurred == -1) {
         if (errno == EINTR) {
@@ -130,9 +188,11 @@ int WaitForEventAndCallHandler(int epollFd)
         return -1;
     }
 
-    if (numEventsOccurred == 1 && event.data.ptr != NULL) {
-        event_data_t *event_data = event.data.ptr;
-        event_data->eventHandler(event_data);
+    for (int i = 0; i < numEventsOccurred; i++) {
+        event_data_t *event_data = events[i].data.ptr;
+        if (event_data != NULL) {
+            event_data->eventHandler(event_data);
+        }
     }
 
     return 0;
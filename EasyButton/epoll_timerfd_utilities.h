@@ -3,6 +3,9 @@
 #include <sys/epoll.h>
 #include <unistd.h>
 
+/// Maximum number of events handled by one call to WaitForEventAndCallHandler.
+#define MAX_EPOLL_EVENTS 8
+
 /// Forward declaration of the data type passed to the handlers.
 struct event_data;
 
@@ -72,9 +75,18 @@ int SetTimerFdToPeriod(int timerFd, const struct timespec *period);
 /// <returns>0 on success, or -1 on failure</returns>
 int SetTimerFdToSingleExpiry(int timerFd, const struct timespec *expiry);
 
+/// <summary>
+///     Sets a timer to fire once only, at an absolute CLOCK_MONOTONIC time.
+/// </summary>
+/// <param name="timerFd">Timer file descriptor</param>
+/// <param name="expiry">The CLOCK_MONOTONIC time at which it expires</param>
+/// <returns>0 on success, or -1 on failure</returns>
+int SetTimerFdToAbsoluteExpiry(int timerFd, const struct timespec *expiry);
+
 /// <summary>
 ///     Consumes an event by reading from the timer file descriptor.
-///     If the event is not consumed, then it will immediately recur.
+///     If the event is not consumed, then it will immediately recur. Succeeds if there is no
+///     expiry to consume, as when the timer was re-armed since the event was reported.
 /// </summary>
 /// <param name="timerFd">Timer file descriptor</param>
 /// <returns>0 on success, or -1 on failure</returns>
@@ -93,7 +105,34 @@ int CreateTimerFdAndAddToEpoll(int epollFd, const struct timespec *period,
                                event_data_t *persistentEventData, const uint32_t epollEventMask);
 
 /// <summary>
-///     Waits for an event on an epoll instance and triggers the handler.
+///     Creates a non-blocking eventfd and adds it to an epoll instance.
+/// </summary>
+/// <param name="epollFd">Epoll file descriptor</param>
+/// <param name="persistentEventData">Persistent event data structure. This must stay in memory
+/// until the handler is removed from the epoll.</param>
+/// <param name="epollEventMask">Bit mask for the epoll event type</param>
+/// <returns>A valid eventfd file descriptor on success, or -1 on failure</returns>
+int CreateEventFdAndAddToEpoll(int epollFd, event_data_t *persistentEventData,
+                               const uint32_t epollEventMask);
+
+/// <summary>
+///     Signals an eventfd so that its epoll handler runs on the next wait.
+/// </summary>
+/// <param name="eventFd">Eventfd file descriptor</param>
+/// <returns>0 on success, or -1 on failure</returns>
+int SignalEventFd(int eventFd);
+
+/// <summary>
+///     Consumes all pending signals by reading from the eventfd.
+///     If the event is not consumed, then it will immediately recur.
+/// </summary>
+/// <param name="eventFd">Eventfd file descriptor</param>
+/// <returns>0 on success, or -1 on failure</returns>
+int ConsumeEventFdEvent(int eventFd);
+
+/// <summary>
+///     Waits for events on an epoll instance and triggers the handler of each event that
+///     occurred, up to MAX_EPOLL_EVENTS per call.
 /// </summary>
 /// <param name="epollFd">Epoll file descriptor</param>
 /// <returns>0 on success, or -1 on failure</returns>
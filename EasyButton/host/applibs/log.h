@@ -0,0 +1,4 @@
+/// Host stand-in for the Azure Sphere applibs log API, implemented by log_host.c.
+#pragma once
+
+int Log_Debug(const char *fmt, ...);
@@ -0,0 +1,19 @@
+/// Host stand-in for the Azure Sphere applibs WiFi configuration API, implemented by
+/// wificonfig_host.c.
+#pragma once
+
+#include <stdint.h>
+
+#define WIFICONFIG_SSID_MAX_LENGTH 32
+
+typedef struct WifiConfig_ConnectedNetwork {
+    uint32_t z__magicAndVersion;
+    uint8_t ssid[WIFICONFIG_SSID_MAX_LENGTH];
+    uint8_t bssid[6];
+    uint8_t ssidLength;
+    uint8_t security;
+    uint32_t frequencyMHz;
+    int8_t signalRssi;
+} WifiConfig_ConnectedNetwork;
+
+int WifiConfig_GetCurrentNetwork(WifiConfig_ConnectedNetwork *connectedNetwork);
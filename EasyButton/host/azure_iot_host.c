@@ -0,0 +1,349 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <applibs/log.h>
+
+#include "azure_iot_utilities.h"
+#include "benchmark.h"
+#include "iot_hub_sim.h"
+
+/// <summary>
+///     Maximum number of messages waiting for their confirmation.
+/// </summary>
+#define MAX_OUTSTANDING_MESSAGES 64
+
+typedef struct OutstandingMessage {
+    uint32_t sequence;
+    uint64_t sentUs;
+    bool isConfirmed;
+    bool delivered;
+} OutstandingMessage;
+
+static MessageReceivedFnType messageReceivedCb = NULL;
+static TwinUpdateFnType twinUpdateCb = NULL;
+static DirectMethodCallFnType directMethodCallCb = NULL;
+static ConnectionStatusFnType connectionStatusCb = NULL;
+static MessageDeliveryConfirmationFnType messageConfirmationCb = NULL;
+
+static bool startedSimulator = false;
+static int clientFd = -1;
+static bool isConnected = false;
+
+// Messages waiting for their confirmation, in send order.
+static OutstandingMessage outstandingMessages[MAX_OUTSTANDING_MESSAGES];
+static size_t outstandingHead = 0;
+static size_t outstandingCount = 0;
+static uint32_t nextSequence = 1;
+
+static uint64_t NowUs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+/// <summary>
+///     Calls the confirmation callback for the oldest messages whose outcome is known, in send
+///     order; once 'flush' is set, for all of them, as not delivered if still unconfirmed.
+/// </summary>
+static void ReportConfirmations(bool flush)
+{
+    uint64_t timeoutUs = IotHubSim_GetConfig()->messageTimeoutUs;
+    uint64_t nowUs = NowUs();
+    while (outstandingCount != 0) {
+        OutstandingMessage *message = &outstandingMessages[outstandingHead];
+        bool timedOut = timeoutUs != 0 && nowUs - message->sentUs >= timeoutUs;
+        if (!message->isConfirmed && !timedOut && !flush) {
+            break;
+        }
+
+        bool delivered = message->isConfirmed && message->delivered;
+        outstandingHead = (outstandingHead + 1) % MAX_OUTSTANDING_MESSAGES;
+        outstandingCount--;
+        if (messageConfirmationCb != NULL) {
+            messageConfirmationCb(delivered);
+        }
+    }
+}
+
+/// <summary>
+///     Records the confirmation of an outstanding message.
+/// </summary>
+static void ConfirmMessage(uint32_t sequence, bool delivered)
+{
+    for (size_t i = 0; i < outstandingCount; i++) {
+        OutstandingMessage *message =
+            &outstandingMessages[(outstandingHead + i) % MAX_OUTSTANDING_MESSAGES];
+        if (message->sequence == sequence) {
+            message->isConfirmed = true;
+            message->delivered = delivered;
+            return;
+        }
+    }
+    // A confirmation after the message timed out.
+}
+
+/// <summary>
+///     Calls a direct method and sends its response to the simulator.
+/// </summary>
+/// <param name="call">The call: "<id> <method name> <payload>".</param>
+static void CallDirectMethod(char *call)
+{
+    char *methodName = strchr(call, ' ');
+    char *payload = methodName != NULL ? strchr(methodName + 1, ' ') : NULL;
+    if (payload == NULL) {
+        Log_Debug("WARNING: Malformed direct method call from the IoT Hub simulator.\n");
+        return;
+    }
+    *methodName++ = '\0';
+    *payload++ = '\0';
+
+    int status = 404;
+    char *response = NULL;
+    size_t responseSize = 0;
+    if (directMethodCallCb != NULL) {
+        status = directMethodCallCb(methodName, payload, strlen(payload), &response,
+                                    &responseSize);
+    }
+
+    char datagram[IOT_HUB_SIM_MAX_DATAGRAM];
+    int length = snprintf(datagram, sizeof(datagram), "r %s %d %.*s", call, status,
+                          (int)responseSize, response != NULL ? response : "");
+    free(response);
+    if (length > 0 && (size_t)length < sizeof(datagram)) {
+        send(clientFd, datagram, (size_t)length, 0);
+    }
+}
+
+/// <summary>
+///     Handles a datagram from the simulator.
+/// </summary>
+static void HandleDatagram(char *datagram)
+{
+    switch (datagram[0]) {
+    case 'h':
+        if (!isConnected) {
+            isConnected = true;
+            if (connectionStatusCb != NULL) {
+                connectionStatusCb(true);
+            }
+        }
+        break;
+    case 'A': {
+        char *end;
+        uint32_t sequence = (uint32_t)strtoul(datagram + 1, &end, 10);
+        ConfirmMessage(sequence, strtol(end, NULL, 10) != 0);
+        break;
+    }
+    case 'C':
+        if (messageReceivedCb != NULL) {
+            messageReceivedCb(datagram + 2);
+        }
+        break;
+    case 'T': {
+        JSON_Value *rootProperties = json_parse_string(datagram + 2);
+        if (rootProperties == NULL) {
+            Log_Debug("WARNING: Cannot parse the desired properties from the IoT Hub simulator.\n");
+            break;
+        }
+        // As the connected service does, pass the desired properties of a full document, or
+        // the root of a delta.
+        JSON_Object *rootObject = json_value_get_object(rootProperties);
+        JSON_Object *desiredProperties = json_object_dotget_object(rootObject, "desired");
+        if (desiredProperties == NULL) {
+            desiredProperties = rootObject;
+        }
+        if (twinUpdateCb != NULL) {
+            twinUpdateCb(desiredProperties);
+        }
+        json_value_free(rootProperties);
+        break;
+    }
+    case 'D':
+        CallDirectMethod(datagram + 2);
+        break;
+    default:
+        Log_Debug("WARNING: Unknown datagram from the IoT Hub simulator.\n");
+        break;
+    }
+}
+
+bool AzureIoT_Initialize(void)
+{
+    if (!IotHubSim_IsRunning()) {
+        IotHubSim_Config config = IotHubSim_DefaultConfig;
+        const char *settings = getenv(IOT_HUB_SIM_CONFIG_VARIABLE);
+        if ((settings != NULL && IotHubSim_ParseConfig(settings, &config) != 0) ||
+            IotHubSim_Start(&config) != 0) {
+            return false;
+        }
+        startedSimulator = true;
+    }
+
+    const char *benchmarkSettings = getenv(BENCHMARK_CONFIG_VARIABLE);
+    if (benchmarkSettings != NULL) {
+        Benchmark_Config benchmarkConfig = Benchmark_DefaultConfig;
+        if (Benchmark_ParseConfig(benchmarkSettings, &benchmarkConfig) != 0 ||
+            Benchmark_Start(&benchmarkConfig) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AzureIoT_Deinitialize(void)
+{
+    Benchmark_Stop();
+    IotHubSim_LogSummary();
+    if (startedSimulator) {
+        IotHubSim_Stop();
+        startedSimulator = false;
+    }
+}
+
+bool AzureIoT_SetupClient(void)
+{
+    if (clientFd >= 0) {
+        return true;
+    }
+
+    clientFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (clientFd < 0) {
+        Log_Debug("ERROR: Could not create the IoT Hub client socket: %s (%d).\n",
+                  strerror(errno), errno);
+        return false;
+    }
+
+    struct sockaddr_in address = {.sin_family = AF_INET,
+                                  .sin_port = htons(IotHubSim_GetPort()),
+                                  .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    if (connect(clientFd, (const struct sockaddr *)&address, sizeof(address)) != 0 ||
+        send(clientFd, "H", 1, 0) != 1) {
+        Log_Debug("ERROR: Could not reach the IoT Hub simulator: %s (%d).\n", strerror(errno),
+                  errno);
+        close(clientFd);
+        clientFd = -1;
+        return false;
+    }
+    return true;
+}
+
+void AzureIoT_DestroyClient(void)
+{
+    if (clientFd < 0) {
+        return;
+    }
+
+    send(clientFd, "B", 1, 0);
+    close(clientFd);
+    clientFd = -1;
+
+    // As the SDK does when its client is destroyed, report the outstanding messages.
+    ReportConfirmations(true);
+    if (isConnected) {
+        isConnected = false;
+        if (connectionStatusCb != NULL) {
+            connectionStatusCb(false);
+        }
+    }
+}
+
+void AzureIoT_DoPeriodicTasks(void)
+{
+    static char datagram[IOT_HUB_SIM_MAX_DATAGRAM + 1];
+
+    while (clientFd >= 0) {
+        ssize_t length = recv(clientFd, datagram, IOT_HUB_SIM_MAX_DATAGRAM, 0);
+        if (length < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                Log_Debug("ERROR: IoT Hub client receive failed: %s (%d).\n", strerror(errno),
+                          errno);
+            }
+            break;
+        }
+        datagram[length] = '\0';
+        HandleDatagram(datagram);
+    }
+
+    ReportConfirmations(false);
+}
+
+void AzureIoT_SendMessage(const char *messagePayload)
+{
+    if (clientFd < 0) {
+        Log_Debug("WARNING: IoT Hub client not initialized.\n");
+        return;
+    }
+
+    if (outstandingCount == MAX_OUTSTANDING_MESSAGES) {
+        Log_Debug("ERROR: Too many messages waiting for a confirmation.\n");
+        return;
+    }
+
+    // A message that cannot be sent is confirmed as not delivered with the next periodic tasks,
+    // never from within this call.
+    uint32_t sequence = nextSequence++;
+    OutstandingMessage *message =
+        &outstandingMessages[(outstandingHead + outstandingCount) % MAX_OUTSTANDING_MESSAGES];
+    *message = (OutstandingMessage){.sequence = sequence, .sentUs = NowUs()};
+    outstandingCount++;
+
+    char datagram[IOT_HUB_SIM_MAX_DATAGRAM];
+    int length = snprintf(datagram, sizeof(datagram), "M %u %s", sequence, messagePayload);
+    if (length < 0 || (size_t)length >= sizeof(datagram)) {
+        Log_Debug("ERROR: Message too long for the IoT Hub simulator.\n");
+        message->isConfirmed = true;
+        return;
+    }
+    if (send(clientFd, datagram, (size_t)length, 0) != length) {
+        Log_Debug("ERROR: Could not send the message: %s (%d).\n", strerror(errno), errno);
+        message->isConfirmed = true;
+    }
+}
+
+void AzureIoT_TwinReportState(const char *propertyName, size_t propertyValue)
+{
+    if (clientFd < 0) {
+        Log_Debug("WARNING: IoT Hub client not initialized.\n");
+        return;
+    }
+
+    char datagram[IOT_HUB_SIM_MAX_DATAGRAM];
+    int length =
+        snprintf(datagram, sizeof(datagram), "R %s %zu", propertyName, propertyValue);
+    if (length > 0 && (size_t)length < sizeof(datagram)) {
+        send(clientFd, datagram, (size_t)length, 0);
+    }
+}
+
+void AzureIoT_SetMessageReceivedCallback(MessageReceivedFnType callback)
+{
+    messageReceivedCb = callback;
+}
+
+void AzureIoT_SetDeviceTwinUpdateCallback(TwinUpdateFnType callback)
+{
+    twinUpdateCb = callback;
+}
+
+void AzureIoT_SetDirectMethodCallback(DirectMethodCallFnType callback)
+{
+    directMethodCallCb = callback;
+}
+
+void AzureIoT_SetConnectionStatusCallback(ConnectionStatusFnType callback)
+{
+    connectionStatusCb = callback;
+}
+
+void AzureIoT_SetMessageConfirmationCallback(MessageDeliveryConfirmationFnType callback)
+{
+    messageConfirmationCb = callback;
+}
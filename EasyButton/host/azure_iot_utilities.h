@@ -0,0 +1,98 @@
+/// Host stand-in for the azure_iot_utilities layer of the Azure IoT Hub connected service,
+/// implemented by azure_iot_host.c.
+///
+/// It declares the same API as the connected service, and carries the application's traffic
+/// over UDP to the IoT Hub simulator of iot_hub_sim.h on the loopback interface, so that
+/// messaging, batching and retries can be exercised end to end on a Linux machine with no
+/// network.
+///
+/// Build the application for the host by compiling the sources in this directory together with
+/// the application sources, with this directory first on the include path, e.g.:
+///     gcc -D AZURE_IOT_HUB_CONFIGURED -D EASYBUTTON_HOST_BUILD -Ihost -I. *.c host/*.c -lpthread
+///
+/// The simulator is configured from IOT_HUB_SIM_CONFIG_VARIABLE. Setting
+/// BENCHMARK_CONFIG_VARIABLE also runs the benchmark driver of benchmark.h, which presses the
+/// buttons, sends cloud traffic, and ends the run after a set duration.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "parson.h"
+
+/// <summary>
+///     Callback for a cloud-to-device message.
+/// </summary>
+typedef void (*MessageReceivedFnType)(const char *payload);
+
+/// <summary>
+///     Callback for a device twin update, with the desired properties.
+/// </summary>
+typedef void (*TwinUpdateFnType)(JSON_Object *desiredProperties);
+
+/// <summary>
+///     Callback for a change of the connection status.
+/// </summary>
+typedef void (*ConnectionStatusFnType)(bool connected);
+
+/// <summary>
+///     Callback for the delivery confirmation of a device-to-cloud message.
+/// </summary>
+typedef void (*MessageDeliveryConfirmationFnType)(bool delivered);
+
+/// <summary>
+///     Callback for a direct method call. The response payload is released with free().
+/// </summary>
+typedef int (*DirectMethodCallFnType)(const char *directMethodName, const char *payload,
+                                      size_t payloadSize, char **responsePayload,
+                                      size_t *responsePayloadSize);
+
+/// <summary>
+///     Initializes the client; starts the IoT Hub simulator if it is not running yet, with its
+///     default configuration updated from the IOT_HUB_SIM_CONFIG_VARIABLE environment variable.
+/// </summary>
+/// <returns>true on success, false otherwise.</returns>
+bool AzureIoT_Initialize(void);
+
+/// <summary>
+///     Releases the client and stops the IoT Hub simulator.
+/// </summary>
+void AzureIoT_Deinitialize(void);
+
+/// <summary>
+///     Sets up the connection to the IoT Hub simulator, if it is not set up yet. The connection
+///     status callback reports when the simulator answers.
+/// </summary>
+/// <returns>true if the client is set up, false otherwise.</returns>
+bool AzureIoT_SetupClient(void);
+
+/// <summary>
+///     Closes the connection to the IoT Hub simulator. Messages waiting for a confirmation are
+///     reported as not delivered.
+/// </summary>
+void AzureIoT_DestroyClient(void);
+
+/// <summary>
+///     Receives what the IoT Hub simulator sent, and calls the callbacks: confirmations in
+///     send order, cloud-to-device messages, device twin updates and direct method calls.
+/// </summary>
+void AzureIoT_DoPeriodicTasks(void);
+
+/// <summary>
+///     Sends a device-to-cloud message.
+/// </summary>
+/// <param name="messagePayload">The message, null terminated.</param>
+void AzureIoT_SendMessage(const char *messagePayload);
+
+/// <summary>
+///     Reports a property to the device twin.
+/// </summary>
+/// <param name="propertyName">The name of the property.</param>
+/// <param name="propertyValue">The value of the property.</param>
+void AzureIoT_TwinReportState(const char *propertyName, size_t propertyValue);
+
+void AzureIoT_SetMessageReceivedCallback(MessageReceivedFnType callback);
+void AzureIoT_SetDeviceTwinUpdateCallback(TwinUpdateFnType callback);
+void AzureIoT_SetDirectMethodCallback(DirectMethodCallFnType callback);
+void AzureIoT_SetConnectionStatusCallback(ConnectionStatusFnType callback);
+void AzureIoT_SetMessageConfirmationCallback(MessageDeliveryConfirmationFnType callback);
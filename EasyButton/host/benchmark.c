@@ -0,0 +1,236 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <applibs/log.h>
+
+#include "benchmark.h"
+#include "gpio_sim.h"
+#include "iot_hub_sim.h"
+#include "mt3620_rdb.h"
+
+/// <summary>
+///     How often the benchmark thread checks whether traffic is due.
+/// </summary>
+#define TICK_US 5000
+
+/// <summary>
+///     How long each simulated press lasts, at most; shortened to half the press period at
+///     high rates.
+/// </summary>
+#define PRESS_DURATION_US 100000
+
+/// <summary>
+///     Number of values of LedBlinkRateProperty.
+/// </summary>
+#define BLINK_RATE_COUNT 3
+
+const Benchmark_Config Benchmark_DefaultConfig = {.durationMs = 10000,
+                                                  .armsPerSecond = 1,
+                                                  .pressesPerSecond = 2,
+                                                  .cloudMessagesPerSecond = 1,
+                                                  .twinUpdatesPerSecond = 1,
+                                                  .directMethodsPerSecond = 1,
+                                                  .seed = 1};
+
+static const char *const colors[] = {"red", "#ff8000", "rgb(0,128,255)", "white"};
+
+static Benchmark_Config benchmarkConfig;
+static pthread_t benchmarkThread;
+static atomic_bool isRunning = false;
+static atomic_bool stopRequested = false;
+
+// Traffic generated by the benchmark thread, read once it has been joined.
+static uint32_t cloudMessagesSent = 0;
+static uint32_t twinUpdatesSent = 0;
+static uint32_t directMethodsSent = 0;
+static uint32_t sendsFailed = 0;
+
+static uint64_t NowUs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+/// <summary>
+///     Returns whether the next of the events occurring 'perSecond' times a second since
+///     'startUs' is due, and counts it in 'count' if so.
+/// </summary>
+static bool IsDue(uint32_t perSecond, uint64_t startUs, uint64_t nowUs, uint32_t *count)
+{
+    if (perSecond == 0 || (uint64_t)*count * 1000000 / perSecond > nowUs - startUs) {
+        return false;
+    }
+    (*count)++;
+    return true;
+}
+
+/// <summary>
+///     Returns the waveform of a button pressed 'perSecond' times a second.
+/// </summary>
+static GpioSim_Waveform ButtonWaveform(GPIO_Value_Type idleValue, uint32_t perSecond)
+{
+    uint32_t durationUs = PRESS_DURATION_US;
+    if (perSecond != 0 && durationUs > 500000 / perSecond) {
+        durationUs = 500000 / perSecond;
+    }
+    return (GpioSim_Waveform){.idleValue = idleValue,
+                              .pressesPerSecond = perSecond,
+                              .pressDurationUs = durationUs,
+                              .bounceDurationUs = durationUs / 20,
+                              .bounceTransitions = 4,
+                              .seed = benchmarkConfig.seed};
+}
+
+static void *BenchmarkThread(void *argument)
+{
+    uint64_t startUs = NowUs();
+    uint64_t endUs = startUs + (uint64_t)benchmarkConfig.durationMs * 1000;
+    char payload[64];
+
+    // Counts of the events due so far, sent or not.
+    uint32_t cloudMessages = 0;
+    uint32_t twinUpdates = 0;
+    uint32_t directMethods = 0;
+
+    while (!atomic_load(&stopRequested)) {
+        uint64_t nowUs = NowUs();
+        if (nowUs >= endUs) {
+            // Let the application log its summaries as it would on any termination request.
+            kill(getpid(), SIGTERM);
+            break;
+        }
+
+        if (IsDue(benchmarkConfig.cloudMessagesPerSecond, startUs, nowUs, &cloudMessages)) {
+            snprintf(payload, sizeof(payload), "{\"benchmark\":%u}", cloudMessages);
+            if (IotHubSim_SendCloudToDeviceMessage(payload) == 0) {
+                cloudMessagesSent++;
+            } else {
+                sendsFailed++;
+            }
+        }
+        if (IsDue(benchmarkConfig.twinUpdatesPerSecond, startUs, nowUs, &twinUpdates)) {
+            snprintf(payload, sizeof(payload), "{\"LedBlinkRateProperty\":%u,\"$version\":%u}",
+                     twinUpdates % BLINK_RATE_COUNT, twinUpdates + 1);
+            if (IotHubSim_SetDesiredProperties(payload) == 0) {
+                twinUpdatesSent++;
+            } else {
+                sendsFailed++;
+            }
+        }
+        if (IsDue(benchmarkConfig.directMethodsPerSecond, startUs, nowUs, &directMethods)) {
+            snprintf(payload, sizeof(payload), "{\"color\":\"%s\"}",
+                     colors[directMethods % (sizeof(colors) / sizeof(*colors))]);
+            if (IotHubSim_InvokeDirectMethod("LedColorControlMethod", payload) == 0) {
+                directMethodsSent++;
+            } else {
+                sendsFailed++;
+            }
+        }
+
+        usleep(TICK_US);
+    }
+    return NULL;
+}
+
+int Benchmark_ParseConfig(const char *settings, Benchmark_Config *config)
+{
+    static const struct {
+        const char *name;
+        size_t offset;
+    } fields[] = {{"durationMs", offsetof(Benchmark_Config, durationMs)},
+                  {"armsPerSecond", offsetof(Benchmark_Config, armsPerSecond)},
+                  {"pressesPerSecond", offsetof(Benchmark_Config, pressesPerSecond)},
+                  {"cloudMessagesPerSecond", offsetof(Benchmark_Config, cloudMessagesPerSecond)},
+                  {"twinUpdatesPerSecond", offsetof(Benchmark_Config, twinUpdatesPerSecond)},
+                  {"directMethodsPerSecond", offsetof(Benchmark_Config, directMethodsPerSecond)},
+                  {"seed", offsetof(Benchmark_Config, seed)}};
+
+    const char *setting = settings;
+    while (*setting != '\0') {
+        const char *equals = strchr(setting, '=');
+        if (equals == NULL) {
+            Log_Debug("ERROR: Malformed benchmark setting \"%s\".\n", setting);
+            return -1;
+        }
+        size_t nameLength = (size_t)(equals - setting);
+        char *end;
+        unsigned long value = strtoul(equals + 1, &end, 10);
+        if (end == equals + 1 || (*end != ',' && *end != '\0')) {
+            Log_Debug("ERROR: Malformed benchmark setting \"%s\".\n", setting);
+            return -1;
+        }
+
+        size_t i = 0;
+        while (i < sizeof(fields) / sizeof(*fields) &&
+               (strlen(fields[i].name) != nameLength ||
+                strncmp(fields[i].name, setting, nameLength) != 0)) {
+            i++;
+        }
+        if (i == sizeof(fields) / sizeof(*fields)) {
+            Log_Debug("ERROR: Unknown benchmark setting \"%.*s\".\n", (int)nameLength, setting);
+            return -1;
+        }
+        *(uint32_t *)((char *)config + fields[i].offset) = (uint32_t)value;
+
+        setting = *end == ',' ? end + 1 : end;
+    }
+    return 0;
+}
+
+int Benchmark_Start(const Benchmark_Config *config)
+{
+    if (atomic_load(&isRunning)) {
+        Log_Debug("ERROR: Benchmark already running.\n");
+        return -1;
+    }
+
+    benchmarkConfig = *config;
+    cloudMessagesSent = 0;
+    twinUpdatesSent = 0;
+    directMethodsSent = 0;
+    sendsFailed = 0;
+
+    // Button A reads low while pressed, the easy button high.
+    GpioSim_Waveform buttonA = ButtonWaveform(GPIO_Value_High, config->armsPerSecond);
+    GpioSim_Waveform easyButton = ButtonWaveform(GPIO_Value_Low, config->pressesPerSecond);
+    if (GpioSim_SetWaveform(MT3620_RDB_BUTTON_A, &buttonA) != 0 ||
+        GpioSim_SetWaveform(MT3620_RDB_HEADER1_PIN4_GPIO, &easyButton) != 0) {
+        return -1;
+    }
+
+    atomic_store(&stopRequested, false);
+    atomic_store(&isRunning, true);
+    if (pthread_create(&benchmarkThread, NULL, BenchmarkThread, NULL) != 0) {
+        Log_Debug("ERROR: Benchmark could not start its thread.\n");
+        atomic_store(&isRunning, false);
+        return -1;
+    }
+
+    Log_Debug("INFO: Benchmark running for %u ms.\n", config->durationMs);
+    return 0;
+}
+
+void Benchmark_Stop(void)
+{
+    if (!atomic_load(&isRunning)) {
+        return;
+    }
+
+    atomic_store(&stopRequested, true);
+    pthread_join(benchmarkThread, NULL);
+    atomic_store(&isRunning, false);
+
+    Log_Debug("INFO: Benchmark: %llu arms and %llu presses generated; %u cloud messages, %u "
+              "twin updates and %u direct method calls sent, %u not sent.\n",
+              (unsigned long long)GpioSim_GetGeneratedPresses(MT3620_RDB_BUTTON_A),
+              (unsigned long long)GpioSim_GetGeneratedPresses(MT3620_RDB_HEADER1_PIN4_GPIO),
+              cloudMessagesSent, twinUpdatesSent, directMethodsSent, sendsFailed);
+}
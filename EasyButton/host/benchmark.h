@@ -0,0 +1,68 @@
+/// Benchmark driver for host (Linux) builds.
+///
+/// Plays presses on the buttons through the GPIO simulator of gpio_sim.h, and cloud traffic
+/// through the IoT Hub simulator of iot_hub_sim.h: cloud-to-device messages, desired property
+/// updates and direct method calls, each at a steady rate. After the configured duration it
+/// logs what it generated and requests the termination of the application with SIGTERM, so
+/// that the application logs its own latency and queue summaries.
+///
+/// The host client starts the driver from AzureIoT_Initialize when BENCHMARK_CONFIG_VARIABLE
+/// is set, and stops it from AzureIoT_Deinitialize.
+#pragma once
+
+#include <stdint.h>
+
+/// <summary>
+///     Configuration of the benchmark driver. Rates are per second; 0 disables the traffic.
+/// </summary>
+typedef struct Benchmark_Config {
+    /// <summary>How long the benchmark runs before it terminates the application.</summary>
+    uint32_t durationMs;
+    /// <summary>Presses on button A, each of which arms the easy button.</summary>
+    uint32_t armsPerSecond;
+    /// <summary>Presses on the easy button.</summary>
+    uint32_t pressesPerSecond;
+    /// <summary>Cloud-to-device messages.</summary>
+    uint32_t cloudMessagesPerSecond;
+    /// <summary>Desired property updates, cycling LedBlinkRateProperty.</summary>
+    uint32_t twinUpdatesPerSecond;
+    /// <summary>Calls of LedColorControlMethod, cycling through colors.</summary>
+    uint32_t directMethodsPerSecond;
+    /// <summary>Seed of the bounce patterns of the buttons.</summary>
+    uint32_t seed;
+} Benchmark_Config;
+
+/// <summary>
+///     Configuration the settings of BENCHMARK_CONFIG_VARIABLE are applied to: 10 s of one arm
+///     and two presses a second, with one message, twin update and direct method call from the
+///     cloud a second.
+/// </summary>
+extern const Benchmark_Config Benchmark_DefaultConfig;
+
+/// <summary>
+///     Environment variable that enables the benchmark, in the format of Benchmark_ParseConfig,
+///     e.g. "durationMs=30000,pressesPerSecond=20". An empty value runs the defaults.
+/// </summary>
+#define BENCHMARK_CONFIG_VARIABLE "EASYBUTTON_BENCHMARK"
+
+/// <summary>
+///     Parses a comma-separated list of "field=value" settings, named after the fields of
+///     Benchmark_Config, over the settings already in 'config'.
+/// </summary>
+/// <param name="settings">The settings.</param>
+/// <param name="config">The configuration to update.</param>
+/// <returns>0 on success, or -1 if a setting is unknown or malformed.</returns>
+int Benchmark_ParseConfig(const char *settings, Benchmark_Config *config);
+
+/// <summary>
+///     Sets the waveforms of the buttons, and starts the thread that sends the cloud traffic
+///     and ends the benchmark. The IoT Hub simulator must be running.
+/// </summary>
+/// <param name="config">The configuration.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int Benchmark_Start(const Benchmark_Config *config);
+
+/// <summary>
+///     Stops the benchmark thread if it is running, and logs what the benchmark generated.
+/// </summary>
+void Benchmark_Stop(void);
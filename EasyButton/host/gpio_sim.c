@@ -0,0 +1,253 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gpio_sim.h"
+
+/// <summary>
+///     Highest file descriptor that can be mapped back to a simulated line.
+/// </summary>
+#define MAX_GPIO_FDS 1024
+
+typedef struct GpioSimLine {
+    bool isOpen;
+    bool isOutput;
+    bool hasWaveform;
+    GPIO_Value_Type value;
+    GpioSim_Waveform waveform;
+    uint64_t startUs;
+} GpioSimLine;
+
+static GpioSimLine lines[GPIO_SIM_MAX_LINES];
+static GPIO_Id fdToGpio[MAX_GPIO_FDS];
+static bool fdIsMapped[MAX_GPIO_FDS];
+static _Atomic uint64_t writeCount = 0;
+static _Atomic uint64_t readCount = 0;
+
+/// <summary>
+///     Returns the length of one cycle of an event occurring 'perSecond' times a second.
+/// </summary>
+static uint64_t PeriodUs(uint32_t perSecond)
+{
+    uint64_t periodUs = 1000000 / perSecond;
+    return periodUs != 0 ? periodUs : 1;
+}
+
+static uint64_t NowUs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+/// <summary>
+///     Small integer hash used to derive reproducible bounce and noise patterns.
+/// </summary>
+static uint32_t Hash(uint32_t seed, uint64_t a, uint64_t b)
+{
+    uint64_t x = seed ^ (a * 0x9E3779B97F4A7C15ULL) ^ (b * 0xC2B2AE3D27D4EB4FULL);
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    return (uint32_t)x;
+}
+
+/// <summary>
+///     Returns the level of a bouncing contact 'offsetUs' into a bounce, where 'settled' is the
+///     level the contact settles to.
+/// </summary>
+static GPIO_Value_Type BounceLevel(const GpioSim_Waveform *waveform, uint64_t press,
+                                   uint64_t offsetUs, GPIO_Value_Type settled)
+{
+    if (waveform->bounceTransitions == 0) {
+        return settled;
+    }
+
+    uint64_t slot = offsetUs * waveform->bounceTransitions / waveform->bounceDurationUs;
+    bool flipped = (Hash(waveform->seed, press, slot) & 1) != 0;
+    return flipped ? (GPIO_Value_Type)!settled : settled;
+}
+
+static GPIO_Value_Type WaveformValue(const GpioSimLine *line, uint64_t nowUs)
+{
+    const GpioSim_Waveform *waveform = &line->waveform;
+    GPIO_Value_Type idle = waveform->idleValue;
+    GPIO_Value_Type active = (GPIO_Value_Type)!idle;
+    uint64_t elapsedUs = nowUs - line->startUs;
+    GPIO_Value_Type value = idle;
+
+    if (waveform->pressesPerSecond != 0) {
+        uint64_t periodUs = PeriodUs(waveform->pressesPerSecond);
+        uint64_t press = elapsedUs / periodUs;
+        uint64_t phaseUs = elapsedUs % periodUs;
+
+        if (phaseUs < waveform->bounceDurationUs) {
+            value = BounceLevel(waveform, press, phaseUs, active);
+        } else if (phaseUs < waveform->pressDurationUs) {
+            value = active;
+        } else if (phaseUs < (uint64_t)waveform->pressDurationUs + waveform->bounceDurationUs) {
+            value = BounceLevel(waveform, press, phaseUs - waveform->pressDurationUs, idle);
+        }
+    }
+
+    if (waveform->noiseBurstsPerSecond != 0 && waveform->noiseBurstDurationUs != 0) {
+        uint64_t periodUs = PeriodUs(waveform->noiseBurstsPerSecond);
+        uint64_t burst = elapsedUs / periodUs;
+        uint64_t phaseUs = elapsedUs % periodUs;
+        uint64_t burstStartUs = Hash(waveform->seed, burst, 0) % periodUs;
+
+        // Within a burst, the line reads a random level every 10 microseconds.
+        if (phaseUs >= burstStartUs && phaseUs - burstStartUs < waveform->noiseBurstDurationUs) {
+            value = (GPIO_Value_Type)(Hash(waveform->seed, burst, 1 + phaseUs / 10) & 1);
+        }
+    }
+
+    return value;
+}
+
+static GpioSimLine *GetLineFromFd(int gpioFd)
+{
+    if (gpioFd < 0 || gpioFd >= MAX_GPIO_FDS || !fdIsMapped[gpioFd]) {
+        errno = EBADF;
+        return NULL;
+    }
+    return &lines[fdToGpio[gpioFd]];
+}
+
+/// <summary>
+///     Opens a real file descriptor for a line, so that the application can close it as usual.
+/// </summary>
+static int OpenLine(GPIO_Id gpioId, bool isOutput, GPIO_Value_Type initialValue)
+{
+    if (gpioId < 0 || gpioId >= GPIO_SIM_MAX_LINES) {
+        errno = ENODEV;
+        return -1;
+    }
+
+    int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fd >= MAX_GPIO_FDS) {
+        close(fd);
+        errno = EMFILE;
+        return -1;
+    }
+
+    GpioSimLine *line = &lines[gpioId];
+    line->isOpen = true;
+    line->isOutput = isOutput;
+    line->value = isOutput ? initialValue : GPIO_Value_High;
+    fdToGpio[fd] = gpioId;
+    fdIsMapped[fd] = true;
+    return fd;
+}
+
+int GPIO_OpenAsInput(GPIO_Id gpioId)
+{
+    return OpenLine(gpioId, false, GPIO_Value_High);
+}
+
+int GPIO_OpenAsOutput(GPIO_Id gpioId, GPIO_OutputMode_Type outputMode,
+                      GPIO_Value_Type initialValue)
+{
+    return OpenLine(gpioId, true, initialValue);
+}
+
+int GPIO_GetValue(int gpioFd, GPIO_Value_Type *outValue)
+{
+    GpioSimLine *line = GetLineFromFd(gpioFd);
+    if (line == NULL) {
+        return -1;
+    }
+
+    readCount++;
+    *outValue = (!line->isOutput && line->hasWaveform) ? WaveformValue(line, NowUs()) : line->value;
+    return 0;
+}
+
+int GPIO_SetValue(int gpioFd, GPIO_Value_Type value)
+{
+    GpioSimLine *line = GetLineFromFd(gpioFd);
+    if (line == NULL) {
+        return -1;
+    }
+    if (!line->isOutput) {
+        errno = EPERM;
+        return -1;
+    }
+
+    writeCount++;
+    line->value = value;
+    return 0;
+}
+
+size_t GpioSim_SetValues(const int *gpioFds, const GPIO_Value_Type *values, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        GpioSimLine *line = GetLineFromFd(gpioFds[i]);
+        if (line == NULL || !line->isOutput) {
+            return i;
+        }
+        line->value = values[i];
+    }
+
+    // A vectored write counts as a single call.
+    if (count != 0) {
+        writeCount++;
+    }
+    return count;
+}
+
+int GpioSim_SetWaveform(GPIO_Id gpioId, const GpioSim_Waveform *waveform)
+{
+    if (gpioId < 0 || gpioId >= GPIO_SIM_MAX_LINES) {
+        errno = ENODEV;
+        return -1;
+    }
+
+    GpioSimLine *line = &lines[gpioId];
+    line->waveform = *waveform;
+    if (line->waveform.bounceDurationUs == 0) {
+        line->waveform.bounceTransitions = 0;
+    }
+    line->startUs = NowUs();
+    line->hasWaveform = true;
+    return 0;
+}
+
+uint64_t GpioSim_GetGeneratedPresses(GPIO_Id gpioId)
+{
+    if (gpioId < 0 || gpioId >= GPIO_SIM_MAX_LINES || !lines[gpioId].hasWaveform ||
+        lines[gpioId].waveform.pressesPerSecond == 0) {
+        return 0;
+    }
+
+    const GpioSimLine *line = &lines[gpioId];
+    uint64_t periodUs = PeriodUs(line->waveform.pressesPerSecond);
+    return (NowUs() - line->startUs) / periodUs + 1;
+}
+
+int GpioSim_GetOutputValue(GPIO_Id gpioId, GPIO_Value_Type *outValue)
+{
+    if (gpioId < 0 || gpioId >= GPIO_SIM_MAX_LINES || !lines[gpioId].isOutput) {
+        errno = ENODEV;
+        return -1;
+    }
+
+    *outValue = lines[gpioId].value;
+    return 0;
+}
+
+uint64_t GpioSim_GetWriteCount(void)
+{
+    return writeCount;
+}
+
+uint64_t GpioSim_GetReadCount(void)
+{
+    return readCount;
+}
@@ -0,0 +1,88 @@
+/// Simulated GPIO backend for host (Linux) builds.
+///
+/// Implements the applibs GPIO API declared in host/applibs/gpio.h. Input lines play a
+/// synthetic waveform computed from CLOCK_MONOTONIC, so that the debounce, scan and messaging
+/// pipeline can be driven at rates and with contact behaviour that a finger cannot produce.
+/// Output lines record the last written value and count writes.
+///
+/// The host build of the application is described in azure_iot_utilities.h, whose IoT Hub
+/// stand-in it also needs.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <applibs/gpio.h>
+
+/// <summary>
+///     Number of GPIO lines the simulator can model.
+/// </summary>
+#define GPIO_SIM_MAX_LINES 128
+
+/// <summary>
+///     Description of the synthetic waveform played on a simulated input line.
+///     All durations are in microseconds.
+/// </summary>
+typedef struct GpioSim_Waveform {
+    /// <summary>Level of the line while the contact is open.</summary>
+    GPIO_Value_Type idleValue;
+    /// <summary>Number of presses per second; 0 never presses.</summary>
+    uint32_t pressesPerSecond;
+    /// <summary>How long the contact stays closed for each press.</summary>
+    uint32_t pressDurationUs;
+    /// <summary>How long the contact bounces after each make and each break.</summary>
+    uint32_t bounceDurationUs;
+    /// <summary>Number of level changes during each bounce.</summary>
+    uint32_t bounceTransitions;
+    /// <summary>Number of noise bursts per second; 0 disables noise.</summary>
+    uint32_t noiseBurstsPerSecond;
+    /// <summary>How long each noise burst lasts.</summary>
+    uint32_t noiseBurstDurationUs;
+    /// <summary>Seed of the bounce and noise patterns, so that runs are reproducible.</summary>
+    uint32_t seed;
+} GpioSim_Waveform;
+
+/// <summary>
+///     Sets the waveform played on an input line. The waveform starts at the time of the call.
+///     Lines without a waveform read their idle value (high).
+/// </summary>
+/// <param name="gpioId">The GPIO to configure.</param>
+/// <param name="waveform">The waveform to play.</param>
+/// <returns>0 on success, or -1 if the GPIO is out of range.</returns>
+int GpioSim_SetWaveform(GPIO_Id gpioId, const GpioSim_Waveform *waveform);
+
+/// <summary>
+///     Returns the number of presses the waveform of an input line has started so far.
+///     Benchmarks compare it with the number of presses the application detected.
+/// </summary>
+/// <param name="gpioId">The GPIO.</param>
+uint64_t GpioSim_GetGeneratedPresses(GPIO_Id gpioId);
+
+/// <summary>
+///     Sets the values of several output lines in one call, as a vectored alternative to
+///     GPIO_SetValue.
+/// </summary>
+/// <param name="gpioFds">The file descriptors of the lines.</param>
+/// <param name="values">The value of each line.</param>
+/// <param name="count">The number of lines.</param>
+/// <returns>The number of leading lines that were set; less than 'count' on failure.</returns>
+size_t GpioSim_SetValues(const int *gpioFds, const GPIO_Value_Type *values, size_t count);
+
+/// <summary>
+///     Returns the last value written to an output line.
+/// </summary>
+/// <param name="gpioId">The GPIO.</param>
+/// <param name="outValue">Receives the value.</param>
+/// <returns>0 on success, or -1 if the GPIO has not been opened as an output.</returns>
+int GpioSim_GetOutputValue(GPIO_Id gpioId, GPIO_Value_Type *outValue);
+
+/// <summary>
+///     Returns the number of GPIO_SetValue calls made on all lines so far.
+/// </summary>
+uint64_t GpioSim_GetWriteCount(void);
+
+/// <summary>
+///     Returns the number of GPIO_GetValue calls made on all lines so far.
+/// </summary>
+uint64_t GpioSim_GetReadCount(void);
@@ -0,0 +1,471 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <applibs/log.h>
+
+#include "iot_hub_sim.h"
+
+/// <summary>
+///     Maximum number of messages waiting for their confirmation.
+/// </summary>
+#define MAX_PENDING_CONFIRMATIONS 256
+
+/// <summary>
+///     Longest time the server thread waits before checking whether it must stop, in
+///     milliseconds.
+/// </summary>
+#define STOP_CHECK_INTERVAL_MS 50
+
+const IotHubSim_Config IotHubSim_DefaultConfig = {.messageTimeoutUs = 5 * 1000 * 1000};
+
+typedef struct PendingConfirmation {
+    uint32_t sequence;
+    bool delivered;
+    uint64_t dueUs;
+} PendingConfirmation;
+
+static IotHubSim_Config simConfig;
+static int serverFd = -1;
+static uint16_t serverPort = 0;
+static pthread_t serverThread;
+static atomic_bool isRunning = false;
+
+// Address of the client, set by its hello; guarded by clientMutex, with the desired properties.
+static pthread_mutex_t clientMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct sockaddr_in clientAddress;
+static bool hasClient = false;
+static char desiredProperties[IOT_HUB_SIM_MAX_DATAGRAM];
+static uint32_t nextMethodCallId = 1;
+
+// Confirmations, in receipt order; their due times never decrease, so that they are sent in
+// order. Only used by the server thread.
+static PendingConfirmation pendingConfirmations[MAX_PENDING_CONFIRMATIONS];
+static size_t pendingHead = 0;
+static size_t pendingCount = 0;
+static uint64_t lastDueUs = 0;
+
+// Throttling token bucket, in millionths of a message.
+static uint64_t throttleTokens = 0;
+static uint64_t throttleUpdatedUs = 0;
+
+static uint32_t randomState = 1;
+
+static _Atomic uint64_t messagesReceived = 0;
+static _Atomic uint64_t messagesConfirmed = 0;
+static _Atomic uint64_t messagesLost = 0;
+static _Atomic uint64_t messagesThrottled = 0;
+static _Atomic uint64_t reportedProperties = 0;
+static _Atomic uint64_t directMethodResponses = 0;
+
+static uint64_t NowUs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+/// <summary>
+///     xorshift32 pseudo-random generator, seeded from the configuration.
+/// </summary>
+static uint32_t NextRandom(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+/// <summary>
+///     Sends a datagram to the client.
+/// </summary>
+/// <returns>0 on success, or -1 if no client is connected or the datagram could not be
+/// sent.</returns>
+static int SendToClient(const char *datagram, size_t length)
+{
+    pthread_mutex_lock(&clientMutex);
+    struct sockaddr_in address = clientAddress;
+    bool connected = hasClient;
+    pthread_mutex_unlock(&clientMutex);
+
+    if (!connected) {
+        return -1;
+    }
+    if (sendto(serverFd, datagram, length, 0, (const struct sockaddr *)&address,
+               sizeof(address)) < 0) {
+        Log_Debug("ERROR: IoT Hub simulator could not send: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+    return 0;
+}
+
+/// <summary>
+///     Formats a datagram and sends it to the client.
+/// </summary>
+static int SendFormattedToClient(const char *format, ...)
+{
+    char datagram[IOT_HUB_SIM_MAX_DATAGRAM];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(datagram, sizeof(datagram), format, args);
+    va_end(args);
+
+    if (length < 0 || (size_t)length >= sizeof(datagram)) {
+        Log_Debug("ERROR: IoT Hub simulator datagram too long.\n");
+        return -1;
+    }
+    return SendToClient(datagram, (size_t)length);
+}
+
+/// <summary>
+///     Returns whether the throttling rate accepts one more message now.
+/// </summary>
+static bool AcceptByThrottle(uint64_t nowUs)
+{
+    if (simConfig.messagesPerSecond == 0) {
+        return true;
+    }
+
+    uint64_t capacity = (uint64_t)(simConfig.burstSize != 0 ? simConfig.burstSize : 1) * 1000000;
+    throttleTokens += (nowUs - throttleUpdatedUs) * simConfig.messagesPerSecond;
+    if (throttleTokens > capacity) {
+        throttleTokens = capacity;
+    }
+    throttleUpdatedUs = nowUs;
+
+    if (throttleTokens < 1000000) {
+        return false;
+    }
+    throttleTokens -= 1000000;
+    return true;
+}
+
+/// <summary>
+///     Handles a device-to-cloud message: drops it, or schedules its confirmation.
+/// </summary>
+static void ReceiveMessage(uint32_t sequence)
+{
+    messagesReceived++;
+    uint64_t nowUs = NowUs();
+
+    bool delivered = AcceptByThrottle(nowUs);
+    uint64_t delayUs = 0;
+    if (!delivered) {
+        messagesThrottled++;
+    } else if (NextRandom() % 1000 < simConfig.lossPerMille) {
+        messagesLost++;
+        return;
+    } else {
+        delayUs = simConfig.latencyUs +
+                  (simConfig.jitterUs != 0 ? NextRandom() % (simConfig.jitterUs + 1) : 0);
+    }
+
+    if (pendingCount == MAX_PENDING_CONFIRMATIONS) {
+        // The client never keeps this many messages outstanding; treat it as a loss.
+        messagesLost++;
+        return;
+    }
+
+    uint64_t dueUs = nowUs + delayUs;
+    if (dueUs < lastDueUs) {
+        dueUs = lastDueUs;
+    }
+    lastDueUs = dueUs;
+    pendingConfirmations[(pendingHead + pendingCount) % MAX_PENDING_CONFIRMATIONS] =
+        (PendingConfirmation){.sequence = sequence, .delivered = delivered, .dueUs = dueUs};
+    pendingCount++;
+}
+
+/// <summary>
+///     Sends the confirmations that are due.
+/// </summary>
+/// <returns>The time until the next confirmation is due, in milliseconds, or -1 if none is
+/// pending.</returns>
+static int SendDueConfirmations(void)
+{
+    uint64_t nowUs = NowUs();
+    while (pendingCount != 0) {
+        PendingConfirmation *pending = &pendingConfirmations[pendingHead];
+        if (pending->dueUs > nowUs) {
+            return (int)((pending->dueUs - nowUs + 999) / 1000);
+        }
+        if (SendFormattedToClient("A %u %d", pending->sequence, pending->delivered ? 1 : 0) ==
+                0 &&
+            pending->delivered) {
+            messagesConfirmed++;
+        }
+        pendingHead = (pendingHead + 1) % MAX_PENDING_CONFIRMATIONS;
+        pendingCount--;
+    }
+    return -1;
+}
+
+/// <summary>
+///     Handles a datagram from the client.
+/// </summary>
+static void HandleDatagram(char *datagram, const struct sockaddr_in *from)
+{
+    switch (datagram[0]) {
+    case 'H': {
+        // A client connects: answer, and send it the full twin document.
+        static char document[IOT_HUB_SIM_MAX_DATAGRAM];
+        pthread_mutex_lock(&clientMutex);
+        clientAddress = *from;
+        hasClient = true;
+        strcpy(document, desiredProperties);
+        pthread_mutex_unlock(&clientMutex);
+
+        SendToClient("h", 1);
+        if (document[0] != '\0') {
+            SendFormattedToClient("T {\"desired\":%s,\"reported\":{}}", document);
+        }
+        break;
+    }
+    case 'B':
+        pthread_mutex_lock(&clientMutex);
+        hasClient = false;
+        pthread_mutex_unlock(&clientMutex);
+        pendingHead = 0;
+        pendingCount = 0;
+        break;
+    case 'M':
+        ReceiveMessage((uint32_t)strtoul(datagram + 1, NULL, 10));
+        break;
+    case 'R':
+        reportedProperties++;
+        break;
+    case 'r':
+        directMethodResponses++;
+        Log_Debug("INFO: IoT Hub simulator received direct method response: %s\n",
+                  datagram + 2);
+        break;
+    default:
+        Log_Debug("WARNING: IoT Hub simulator received an unknown datagram.\n");
+        break;
+    }
+}
+
+static void *ServerThread(void *argument)
+{
+    static char datagram[IOT_HUB_SIM_MAX_DATAGRAM + 1];
+
+    while (atomic_load(&isRunning)) {
+        int timeoutMs = SendDueConfirmations();
+        if (timeoutMs < 0 || timeoutMs > STOP_CHECK_INTERVAL_MS) {
+            timeoutMs = STOP_CHECK_INTERVAL_MS;
+        }
+
+        struct pollfd pollFd = {.fd = serverFd, .events = POLLIN};
+        if (poll(&pollFd, 1, timeoutMs) <= 0) {
+            continue;
+        }
+
+        struct sockaddr_in from;
+        socklen_t fromLength = sizeof(from);
+        ssize_t length = recvfrom(serverFd, datagram, IOT_HUB_SIM_MAX_DATAGRAM, 0,
+                                  (struct sockaddr *)&from, &fromLength);
+        if (length <= 0) {
+            continue;
+        }
+        datagram[length] = '\0';
+        HandleDatagram(datagram, &from);
+    }
+    return NULL;
+}
+
+int IotHubSim_ParseConfig(const char *settings, IotHubSim_Config *config)
+{
+    static const struct {
+        const char *name;
+        size_t offset;
+    } fields[] = {{"port", offsetof(IotHubSim_Config, port)},
+                  {"latencyUs", offsetof(IotHubSim_Config, latencyUs)},
+                  {"jitterUs", offsetof(IotHubSim_Config, jitterUs)},
+                  {"lossPerMille", offsetof(IotHubSim_Config, lossPerMille)},
+                  {"messagesPerSecond", offsetof(IotHubSim_Config, messagesPerSecond)},
+                  {"burstSize", offsetof(IotHubSim_Config, burstSize)},
+                  {"messageTimeoutUs", offsetof(IotHubSim_Config, messageTimeoutUs)},
+                  {"seed", offsetof(IotHubSim_Config, seed)}};
+
+    const char *setting = settings;
+    while (*setting != '\0') {
+        const char *equals = strchr(setting, '=');
+        if (equals == NULL) {
+            Log_Debug("ERROR: Malformed IoT Hub simulator setting \"%s\".\n", setting);
+            return -1;
+        }
+        size_t nameLength = (size_t)(equals - setting);
+        char *end;
+        unsigned long value = strtoul(equals + 1, &end, 10);
+        if (end == equals + 1 || (*end != ',' && *end != '\0')) {
+            Log_Debug("ERROR: Malformed IoT Hub simulator setting \"%s\".\n", setting);
+            return -1;
+        }
+
+        size_t i = 0;
+        while (i < sizeof(fields) / sizeof(*fields) &&
+               (strlen(fields[i].name) != nameLength ||
+                strncmp(fields[i].name, setting, nameLength) != 0)) {
+            i++;
+        }
+        if (i == sizeof(fields) / sizeof(*fields)) {
+            Log_Debug("ERROR: Unknown IoT Hub simulator setting \"%.*s\".\n", (int)nameLength,
+                      setting);
+            return -1;
+        }
+        if (fields[i].offset == offsetof(IotHubSim_Config, port)) {
+            config->port = (uint16_t)value;
+        } else {
+            *(uint32_t *)((char *)config + fields[i].offset) = (uint32_t)value;
+        }
+
+        setting = *end == ',' ? end + 1 : end;
+    }
+    return 0;
+}
+
+int IotHubSim_Start(const IotHubSim_Config *config)
+{
+    if (atomic_load(&isRunning)) {
+        Log_Debug("ERROR: IoT Hub simulator already running.\n");
+        return -1;
+    }
+
+    serverFd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (serverFd < 0) {
+        Log_Debug("ERROR: IoT Hub simulator could not create its socket: %s (%d).\n",
+                  strerror(errno), errno);
+        return -1;
+    }
+
+    struct sockaddr_in address = {.sin_family = AF_INET,
+                                  .sin_port = htons(config->port),
+                                  .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addressLength = sizeof(address);
+    if (bind(serverFd, (const struct sockaddr *)&address, sizeof(address)) != 0 ||
+        getsockname(serverFd, (struct sockaddr *)&address, &addressLength) != 0) {
+        Log_Debug("ERROR: IoT Hub simulator could not bind its socket: %s (%d).\n",
+                  strerror(errno), errno);
+        close(serverFd);
+        serverFd = -1;
+        return -1;
+    }
+
+    simConfig = *config;
+    serverPort = ntohs(address.sin_port);
+    randomState = config->seed != 0 ? config->seed : 1;
+    hasClient = false;
+    desiredProperties[0] = '\0';
+    pendingHead = 0;
+    pendingCount = 0;
+    lastDueUs = 0;
+    throttleUpdatedUs = NowUs();
+    throttleTokens = (uint64_t)(config->burstSize != 0 ? config->burstSize : 1) * 1000000;
+
+    atomic_store(&isRunning, true);
+    if (pthread_create(&serverThread, NULL, ServerThread, NULL) != 0) {
+        Log_Debug("ERROR: IoT Hub simulator could not start its thread.\n");
+        atomic_store(&isRunning, false);
+        close(serverFd);
+        serverFd = -1;
+        return -1;
+    }
+
+    Log_Debug("INFO: IoT Hub simulator listening on 127.0.0.1:%u.\n", serverPort);
+    return 0;
+}
+
+void IotHubSim_Stop(void)
+{
+    if (!atomic_load(&isRunning)) {
+        return;
+    }
+
+    atomic_store(&isRunning, false);
+    pthread_join(serverThread, NULL);
+    close(serverFd);
+    serverFd = -1;
+    serverPort = 0;
+}
+
+bool IotHubSim_IsRunning(void)
+{
+    return atomic_load(&isRunning);
+}
+
+uint16_t IotHubSim_GetPort(void)
+{
+    return serverPort;
+}
+
+const IotHubSim_Config *IotHubSim_GetConfig(void)
+{
+    return &simConfig;
+}
+
+int IotHubSim_SendCloudToDeviceMessage(const char *payload)
+{
+    return SendFormattedToClient("C %s", payload);
+}
+
+int IotHubSim_SetDesiredProperties(const char *json)
+{
+    if (strlen(json) + sizeof("T {\"desired\":,\"reported\":{}}") > sizeof(desiredProperties)) {
+        Log_Debug("ERROR: Desired properties too long for the IoT Hub simulator.\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&clientMutex);
+    strcpy(desiredProperties, json);
+    bool connected = hasClient;
+    pthread_mutex_unlock(&clientMutex);
+
+    if (connected) {
+        SendFormattedToClient("T %s", json);
+    }
+    return 0;
+}
+
+int IotHubSim_InvokeDirectMethod(const char *methodName, const char *payload)
+{
+    pthread_mutex_lock(&clientMutex);
+    uint32_t callId = nextMethodCallId++;
+    pthread_mutex_unlock(&clientMutex);
+
+    return SendFormattedToClient("D %u %s %s", callId, methodName, payload);
+}
+
+void IotHubSim_GetStats(IotHubSim_Stats *stats)
+{
+    stats->messagesReceived = messagesReceived;
+    stats->messagesConfirmed = messagesConfirmed;
+    stats->messagesLost = messagesLost;
+    stats->messagesThrottled = messagesThrottled;
+    stats->reportedProperties = reportedProperties;
+    stats->directMethodResponses = directMethodResponses;
+}
+
+void IotHubSim_LogSummary(void)
+{
+    IotHubSim_Stats stats;
+    IotHubSim_GetStats(&stats);
+    Log_Debug("INFO: IoT Hub simulator: %llu messages received, %llu confirmed, %llu lost, "
+              "%llu throttled, %llu reported properties, %llu direct method responses.\n",
+              (unsigned long long)stats.messagesReceived,
+              (unsigned long long)stats.messagesConfirmed,
+              (unsigned long long)stats.messagesLost,
+              (unsigned long long)stats.messagesThrottled,
+              (unsigned long long)stats.reportedProperties,
+              (unsigned long long)stats.directMethodResponses);
+}
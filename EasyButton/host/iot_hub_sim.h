@@ -0,0 +1,141 @@
+/// Local IoT Hub stand-in for host (Linux) builds.
+///
+/// Runs a UDP server on the loopback interface, on its own thread, that plays the part of the
+/// IoT Hub for the host azure_iot_utilities client (azure_iot_host.c): it confirms
+/// device-to-cloud messages, records reported properties, and pushes cloud-to-device messages,
+/// desired properties and direct method calls. Confirmation latency, message loss and
+/// throttling can be injected, so that messaging, batching and retry behaviour can be
+/// benchmarked end to end with no network.
+///
+/// Confirmations are sent in the order the messages were received, as the IoT Hub SDK reports
+/// them. A lost message is never confirmed; the client reports it as not delivered once its
+/// message timeout expires. A throttled message is confirmed as not delivered.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+///     Maximum size of a datagram between the client and the simulator.
+/// </summary>
+#define IOT_HUB_SIM_MAX_DATAGRAM 8192
+
+/// <summary>
+///     Configuration of the simulator. All durations are in microseconds.
+/// </summary>
+typedef struct IotHubSim_Config {
+    /// <summary>UDP port on 127.0.0.1; 0 picks a free port.</summary>
+    uint16_t port;
+    /// <summary>Time from the receipt of a message to its confirmation.</summary>
+    uint32_t latencyUs;
+    /// <summary>Maximum random time added to the latency of each confirmation.</summary>
+    uint32_t jitterUs;
+    /// <summary>Number of messages out of 1000 that are lost.</summary>
+    uint32_t lossPerMille;
+    /// <summary>Sustained number of messages accepted per second; 0 disables throttling.</summary>
+    uint32_t messagesPerSecond;
+    /// <summary>Number of messages accepted in a burst above the sustained rate.</summary>
+    uint32_t burstSize;
+    /// <summary>Time after which the client reports an unconfirmed message as not
+    /// delivered.</summary>
+    uint32_t messageTimeoutUs;
+    /// <summary>Seed of the loss and jitter patterns, so that runs are reproducible.</summary>
+    uint32_t seed;
+} IotHubSim_Config;
+
+/// <summary>
+///     Counters of the simulator.
+/// </summary>
+typedef struct IotHubSim_Stats {
+    uint64_t messagesReceived;
+    uint64_t messagesConfirmed;
+    uint64_t messagesLost;
+    uint64_t messagesThrottled;
+    uint64_t reportedProperties;
+    uint64_t directMethodResponses;
+} IotHubSim_Stats;
+
+/// <summary>
+///     Configuration used when the client starts the simulator itself: no impairment, and a
+///     message timeout of 5 s.
+/// </summary>
+extern const IotHubSim_Config IotHubSim_DefaultConfig;
+
+/// <summary>
+///     Environment variable read by the client when it starts the simulator itself, in the
+///     format of IotHubSim_ParseConfig, e.g. "latencyUs=20000,lossPerMille=10".
+/// </summary>
+#define IOT_HUB_SIM_CONFIG_VARIABLE "EASYBUTTON_IOT_HUB_SIM"
+
+/// <summary>
+///     Parses a comma-separated list of "field=value" settings, named after the fields of
+///     IotHubSim_Config, over the settings already in 'config'.
+/// </summary>
+/// <param name="settings">The settings.</param>
+/// <param name="config">The configuration to update.</param>
+/// <returns>0 on success, or -1 if a setting is unknown or malformed.</returns>
+int IotHubSim_ParseConfig(const char *settings, IotHubSim_Config *config);
+
+/// <summary>
+///     Starts the simulator thread. A harness may call it before AzureIoT_Initialize;
+///     otherwise the client starts it with the settings of IOT_HUB_SIM_CONFIG_VARIABLE.
+/// </summary>
+/// <param name="config">The configuration.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int IotHubSim_Start(const IotHubSim_Config *config);
+
+/// <summary>
+///     Stops the simulator thread.
+/// </summary>
+void IotHubSim_Stop(void);
+
+/// <summary>
+///     Returns whether the simulator is running.
+/// </summary>
+bool IotHubSim_IsRunning(void);
+
+/// <summary>
+///     Returns the UDP port of the simulator, or 0 if it is not running.
+/// </summary>
+uint16_t IotHubSim_GetPort(void);
+
+/// <summary>
+///     Returns the configuration of the running simulator.
+/// </summary>
+const IotHubSim_Config *IotHubSim_GetConfig(void);
+
+/// <summary>
+///     Sends a cloud-to-device message to the client.
+/// </summary>
+/// <param name="payload">The message, null terminated.</param>
+/// <returns>0 on success, or -1 if no client is connected or the message is too long.</returns>
+int IotHubSim_SendCloudToDeviceMessage(const char *payload);
+
+/// <summary>
+///     Sets the desired properties of the device twin, and sends them to the client as a delta.
+///     They are sent again, in a full twin document, whenever the client connects.
+/// </summary>
+/// <param name="json">The desired properties, as a JSON object with a "$version".</param>
+/// <returns>0 on success, or -1 if the document is too long. Succeeds with no client
+/// connected.</returns>
+int IotHubSim_SetDesiredProperties(const char *json);
+
+/// <summary>
+///     Calls a direct method on the client; the response is logged when it arrives.
+/// </summary>
+/// <param name="methodName">The name of the method.</param>
+/// <param name="payload">The payload, null terminated.</param>
+/// <returns>0 on success, or -1 if no client is connected or the call is too long.</returns>
+int IotHubSim_InvokeDirectMethod(const char *methodName, const char *payload);
+
+/// <summary>
+///     Gets the counters of the simulator.
+/// </summary>
+/// <param name="stats">Receives the counters.</param>
+void IotHubSim_GetStats(IotHubSim_Stats *stats);
+
+/// <summary>
+///     Logs the counters of the simulator.
+/// </summary>
+void IotHubSim_LogSummary(void);
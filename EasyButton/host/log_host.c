@@ -0,0 +1,13 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <applibs/log.h>
+
+int Log_Debug(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int result = vfprintf(stderr, fmt, args);
+    va_end(args);
+    return result;
+}
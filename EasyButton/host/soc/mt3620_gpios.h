@@ -0,0 +1,98 @@
+/// Host stand-in for the MT3620 GPIO definitions.
+#pragma once
+
+#define MT3620_GPIO0 (0)
+#define MT3620_GPIO1 (1)
+#define MT3620_GPIO2 (2)
+#define MT3620_GPIO3 (3)
+#define MT3620_GPIO4 (4)
+#define MT3620_GPIO5 (5)
+#define MT3620_GPIO6 (6)
+#define MT3620_GPIO7 (7)
+#define MT3620_GPIO8 (8)
+#define MT3620_GPIO9 (9)
+#define MT3620_GPIO10 (10)
+#define MT3620_GPIO11 (11)
+#define MT3620_GPIO12 (12)
+#define MT3620_GPIO13 (13)
+#define MT3620_GPIO14 (14)
+#define MT3620_GPIO15 (15)
+#define MT3620_GPIO16 (16)
+#define MT3620_GPIO17 (17)
+#define MT3620_GPIO18 (18)
+#define MT3620_GPIO19 (19)
+#define MT3620_GPIO20 (20)
+#define MT3620_GPIO21 (21)
+#define MT3620_GPIO22 (22)
+#define MT3620_GPIO23 (23)
+#define MT3620_GPIO24 (24)
+#define MT3620_GPIO25 (25)
+#define MT3620_GPIO26 (26)
+#define MT3620_GPIO27 (27)
+#define MT3620_GPIO28 (28)
+#define MT3620_GPIO29 (29)
+#define MT3620_GPIO30 (30)
+#define MT3620_GPIO31 (31)
+#define MT3620_GPIO32 (32)
+#define MT3620_GPIO33 (33)
+#define MT3620_GPIO34 (34)
+#define MT3620_GPIO35 (35)
+#define MT3620_GPIO36 (36)
+#define MT3620_GPIO37 (37)
+#define MT3620_GPIO38 (38)
+#define MT3620_GPIO39 (39)
+#define MT3620_GPIO40 (40)
+#define MT3620_GPIO41 (41)
+#define MT3620_GPIO42 (42)
+#define MT3620_GPIO43 (43)
+#define MT3620_GPIO44 (44)
+#define MT3620_GPIO45 (45)
+#define MT3620_GPIO46 (46)
+#define MT3620_GPIO47 (47)
+#define MT3620_GPIO48 (48)
+#define MT3620_GPIO49 (49)
+#define MT3620_GPIO50 (50)
+#define MT3620_GPIO51 (51)
+#define MT3620_GPIO52 (52)
+#define MT3620_GPIO53 (53)
+#define MT3620_GPIO54 (54)
+#define MT3620_GPIO55 (55)
+#define MT3620_GPIO56 (56)
+#define MT3620_GPIO57 (57)
+#define MT3620_GPIO58 (58)
+#define MT3620_GPIO59 (59)
+#define MT3620_GPIO60 (60)
+#define MT3620_GPIO61 (61)
+#define MT3620_GPIO62 (62)
+#define MT3620_GPIO63 (63)
+#define MT3620_GPIO64 (64)
+#define MT3620_GPIO65 (65)
+#define MT3620_GPIO66 (66)
+#define MT3620_GPIO67 (67)
+#define MT3620_GPIO68 (68)
+#define MT3620_GPIO69 (69)
+#define MT3620_GPIO70 (70)
+#define MT3620_GPIO71 (71)
+#define MT3620_GPIO72 (72)
+#define MT3620_GPIO73 (73)
+#define MT3620_GPIO74 (74)
+#define MT3620_GPIO75 (75)
+#define MT3620_GPIO76 (76)
+#define MT3620_GPIO77 (77)
+#define MT3620_GPIO78 (78)
+#define MT3620_GPIO79 (79)
+#define MT3620_GPIO80 (80)
+#define MT3620_GPIO81 (81)
+#define MT3620_GPIO82 (82)
+#define MT3620_GPIO83 (83)
+#define MT3620_GPIO84 (84)
+#define MT3620_GPIO85 (85)
+#define MT3620_GPIO86 (86)
+#define MT3620_GPIO87 (87)
+#define MT3620_GPIO88 (88)
+#define MT3620_GPIO89 (89)
+#define MT3620_GPIO90 (90)
+#define MT3620_GPIO91 (91)
+#define MT3620_GPIO92 (92)
+#define MT3620_GPIO93 (93)
+#define MT3620_GPIO94 (94)
@@ -0,0 +1,7 @@
+/// Host stand-in for the MT3620 UART definitions.
+#pragma once
+
+#define MT3620_UART_ISU0 (0)
+#define MT3620_UART_ISU1 (1)
+#define MT3620_UART_ISU2 (2)
+#define MT3620_UART_ISU3 (3)
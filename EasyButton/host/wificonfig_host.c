@@ -0,0 +1,10 @@
+#include <errno.h>
+
+#include <applibs/wificonfig.h>
+
+int WifiConfig_GetCurrentNetwork(WifiConfig_ConnectedNetwork *connectedNetwork)
+{
+    // The host is never connected through the WiFi configuration API.
+    errno = ENOTCONN;
+    return -1;
+}
@@ -0,0 +1,199 @@
+#define _GNU_SOURCE // For pthread_setaffinity_np.
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <applibs/log.h>
+
+#include "epoll_timerfd_utilities.h"
+#include "input_scanner.h"
+
+typedef struct ScannedInput {
+    InputScanner_InputConfig config;
+    int64_t holdOffNs;
+    int fd;
+    GPIO_Value_Type state;
+    struct timespec lastChange;
+} ScannedInput;
+
+static ScannedInput scannedInputs[INPUT_SCANNER_MAX_INPUTS];
+static size_t scannedInputCount = 0;
+static ButtonEventQueue *eventQueue = NULL;
+static int eventQueueFd = -1;
+
+static LatencyHistogram sampleIntervals;
+static struct timespec lastSample;
+static bool hasSampled = false;
+
+static pthread_t busyPollThread;
+static bool busyPollThreadStarted = false;
+static atomic_bool busyPollStopRequested = false;
+static atomic_bool busyPollFailed = false;
+
+static int64_t ElapsedNanoseconds(const struct timespec *start, const struct timespec *end)
+{
+    return (int64_t)(end->tv_sec - start->tv_sec) * 1000000000LL + (end->tv_nsec - start->tv_nsec);
+}
+
+int InputScanner_Open(const InputScanner_InputConfig *inputs, size_t inputCount,
+                      ButtonEventQueue *queue, int eventFd)
+{
+    if (inputCount > INPUT_SCANNER_MAX_INPUTS) {
+        Log_Debug("ERROR: Cannot scan more than %d inputs.\n", INPUT_SCANNER_MAX_INPUTS);
+        return -1;
+    }
+
+    eventQueue = queue;
+    eventQueueFd = eventFd;
+
+    for (size_t i = 0; i < inputCount; i++) {
+        ScannedInput *scanned = &scannedInputs[i];
+        scanned->config = inputs[i];
+        scanned->holdOffNs =
+            (int64_t)inputs[i].holdOff.tv_sec * 1000000000LL + inputs[i].holdOff.tv_nsec;
+        scanned->state = (GPIO_Value_Type)!inputs[i].pressedValue;
+        scanned->lastChange.tv_sec = 0;
+        scanned->lastChange.tv_nsec = 0;
+
+        Log_Debug("INFO: Opening GPIO %d as button input.\n", inputs[i].gpioId);
+        scanned->fd = GPIO_OpenAsInput(inputs[i].gpioId);
+        if (scanned->fd < 0) {
+            Log_Debug("ERROR: Could not open GPIO '%d': %d (%s).\n", inputs[i].gpioId, errno,
+                      strerror(errno));
+            scannedInputCount = i;
+            return -1;
+        }
+    }
+
+    scannedInputCount = inputCount;
+    return 0;
+}
+
+int InputScanner_Poll(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (hasSampled) {
+        LatencyHistogram_Record(&sampleIntervals,
+                                (uint64_t)ElapsedNanoseconds(&lastSample, &now) / 1000);
+    }
+    lastSample = now;
+    hasSampled = true;
+
+    for (size_t i = 0; i < scannedInputCount; i++) {
+        ScannedInput *scanned = &scannedInputs[i];
+        GPIO_Value_Type newState;
+        if (GPIO_GetValue(scanned->fd, &newState) != 0) {
+            Log_Debug("ERROR: Could not read button GPIO %d: %s (%d).\n", scanned->config.gpioId,
+                      strerror(errno), errno);
+            return -1;
+        }
+
+        if (newState == scanned->state) {
+            continue;
+        }
+
+        // Changes within the hold-off time of the last reported change are contact bounce:
+        // track them, but do not report them.
+        bool report = ElapsedNanoseconds(&scanned->lastChange, &now) >= scanned->holdOffNs;
+        scanned->state = newState;
+        if (!report) {
+            continue;
+        }
+
+        scanned->lastChange = now;
+        if (newState == scanned->config.pressedValue &&
+            ButtonEventQueue_Push(eventQueue, scanned->config.input, &now)) {
+            if (SignalEventFd(eventQueueFd) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/// <summary>
+///     Body of the busy-poll thread.
+/// </summary>
+static void *BusyPollThread(void *context)
+{
+    bool yieldEachPoll = (bool)(intptr_t)context;
+
+    while (!atomic_load_explicit(&busyPollStopRequested, memory_order_relaxed)) {
+        if (InputScanner_Poll() != 0) {
+            atomic_store(&busyPollFailed, true);
+            // Wake the consumer so that it notices the failure.
+            SignalEventFd(eventQueueFd);
+            break;
+        }
+        if (yieldEachPoll) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+int InputScanner_StartBusyPoll(void)
+{
+    // Dedicate the last online CPU to the scanner. With a single CPU, the scanner yields after
+    // each poll so that the event loop still runs.
+    long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+    bool yieldEachPoll = cpuCount <= 1;
+    if (yieldEachPoll) {
+        Log_Debug("WARNING: Only one CPU available; busy-poll input will share it.\n");
+    }
+
+    atomic_store(&busyPollStopRequested, false);
+    atomic_store(&busyPollFailed, false);
+    int result =
+        pthread_create(&busyPollThread, NULL, BusyPollThread, (void *)(intptr_t)yieldEachPoll);
+    if (result != 0) {
+        Log_Debug("ERROR: Could not start busy-poll input thread: %s (%d).\n", strerror(result),
+                  result);
+        return -1;
+    }
+    busyPollThreadStarted = true;
+
+    if (!yieldEachPoll) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET((int)cpuCount - 1, &cpus);
+        result = pthread_setaffinity_np(busyPollThread, sizeof(cpus), &cpus);
+        if (result != 0) {
+            Log_Debug("WARNING: Could not pin busy-poll input thread: %s (%d).\n",
+                      strerror(result), result);
+        }
+    }
+
+    return 0;
+}
+
+bool InputScanner_HasFailed(void)
+{
+    return atomic_load(&busyPollFailed);
+}
+
+const LatencyHistogram *InputScanner_GetSampleIntervalHistogram(void)
+{
+    return &sampleIntervals;
+}
+
+void InputScanner_Close(void)
+{
+    if (busyPollThreadStarted) {
+        atomic_store(&busyPollStopRequested, true);
+        pthread_join(busyPollThread, NULL);
+        busyPollThreadStarted = false;
+    }
+
+    for (size_t i = 0; i < scannedInputCount; i++) {
+        CloseFdAndPrintError(scannedInputs[i].fd, "ButtonInput");
+    }
+    scannedInputCount = 0;
+}
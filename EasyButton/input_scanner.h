@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include <applibs/gpio.h>
+
+#include "button_event_queue.h"
+#include "latency_trace.h"
+
+/// <summary>
+///     Maximum number of inputs handled by the scanner.
+/// </summary>
+#define INPUT_SCANNER_MAX_INPUTS 8
+
+/// <summary>
+///     Description of a button input scanned by the input scanner.
+/// </summary>
+typedef struct InputScanner_InputConfig {
+    /// <summary>The GPIO of the button.</summary>
+    GPIO_Id gpioId;
+    /// <summary>The input reported in the button events of this button.</summary>
+    ButtonEvent_Input input;
+    /// <summary>The level of the GPIO while the button is pressed.</summary>
+    GPIO_Value_Type pressedValue;
+    /// <summary>
+    ///     Level changes closer than this to the last reported change are ignored; zero reports
+    ///     every change.
+    /// </summary>
+    struct timespec holdOff;
+} InputScanner_InputConfig;
+
+/// <summary>
+///     Opens the GPIOs of the given inputs. Presses detected by the scanner are pushed to
+///     'queue' and signalled on 'eventFd'.
+/// </summary>
+/// <param name="inputs">The inputs to scan.</param>
+/// <param name="inputCount">The number of inputs.</param>
+/// <param name="queue">The queue receiving the button events. The scanner is its only
+/// producer.</param>
+/// <param name="eventFd">The eventfd signalled after each queued press.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int InputScanner_Open(const InputScanner_InputConfig *inputs, size_t inputCount,
+                      ButtonEventQueue *queue, int eventFd);
+
+/// <summary>
+///     Samples every input once and queues the presses detected.
+///     Must not be called while the busy-poll thread is running.
+/// </summary>
+/// <returns>0 on success, or -1 if a GPIO could not be read.</returns>
+int InputScanner_Poll(void);
+
+/// <summary>
+///     Starts a dedicated thread that polls the inputs continuously, for the lowest possible
+///     press latency at the cost of keeping one core busy.
+/// </summary>
+/// <returns>0 on success, or -1 on failure.</returns>
+int InputScanner_StartBusyPoll(void);
+
+/// <summary>
+///     Returns whether the busy-poll thread stopped because a GPIO could not be read.
+/// </summary>
+bool InputScanner_HasFailed(void);
+
+/// <summary>
+///     Returns the histogram of the time between two consecutive samples of the inputs, which
+///     bounds the delay between a level change and its detection.
+///     Only read it when the busy-poll thread is not running.
+/// </summary>
+const LatencyHistogram *InputScanner_GetSampleIntervalHistogram(void);
+
+/// <summary>
+///     Stops the busy-poll thread, if running, and closes the GPIOs of the inputs.
+/// </summary>
+void InputScanner_Close(void);
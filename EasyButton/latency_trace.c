@@ -0,0 +1,130 @@
+#include <stddef.h>
+
+#include <applibs/log.h>
+
+#include "latency_trace.h"
+
+static const char *stageNames[LatencyTrace_Stage_Count] = {
+    "edge->dispatch", "edge->send", "send->queued", "queued->delivered", "edge->delivered"};
+
+static LatencyHistogram histograms[LatencyTrace_Stage_Count];
+static uint32_t nextTraceId = 1;
+static uint32_t failedDeliveries = 0;
+
+struct timespec LatencyTrace_Now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now;
+}
+
+uint64_t LatencyTrace_ElapsedMicroseconds(const struct timespec *start, const struct timespec *end)
+{
+    int64_t nanoseconds = (int64_t)(end->tv_sec - start->tv_sec) * 1000000000LL +
+                          (int64_t)(end->tv_nsec - start->tv_nsec);
+    return nanoseconds > 0 ? (uint64_t)nanoseconds / 1000 : 0;
+}
+
+void LatencyHistogram_Record(LatencyHistogram *histogram, uint64_t microseconds)
+{
+    size_t bucket = 0;
+    while (bucket < LATENCY_HISTOGRAM_BUCKETS - 1 && (microseconds >> bucket) != 0) {
+        bucket++;
+    }
+
+    histogram->buckets[bucket]++;
+    if (histogram->count == 0 || microseconds < histogram->minMicroseconds) {
+        histogram->minMicroseconds = microseconds;
+    }
+    if (microseconds > histogram->maxMicroseconds) {
+        histogram->maxMicroseconds = microseconds;
+    }
+    histogram->count++;
+    histogram->sumMicroseconds += microseconds;
+}
+
+uint64_t LatencyHistogram_Percentile(const LatencyHistogram *histogram, unsigned int percentile)
+{
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = ((uint64_t)histogram->count * percentile + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS - 1; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank) {
+            uint64_t upperBound = (uint64_t)1 << bucket;
+            return upperBound < histogram->maxMicroseconds ? upperBound
+                                                           : histogram->maxMicroseconds;
+        }
+    }
+
+    return histogram->maxMicroseconds;
+}
+
+void LatencyTrace_Record(LatencyTrace_Stage stage, const struct timespec *start,
+                         const struct timespec *end)
+{
+    LatencyHistogram_Record(&histograms[stage], LatencyTrace_ElapsedMicroseconds(start, end));
+}
+
+void LatencyHistogram_LogSummary(const char *name, const LatencyHistogram *histogram)
+{
+    if (histogram->count == 0) {
+        return;
+    }
+
+    Log_Debug("INFO: Latency %s: n=%u min=%lluus mean=%lluus p50<=%lluus p99<=%lluus "
+              "max=%lluus.\n",
+              name, histogram->count, (unsigned long long)histogram->minMicroseconds,
+              (unsigned long long)(histogram->sumMicroseconds / histogram->count),
+              (unsigned long long)LatencyHistogram_Percentile(histogram, 50),
+              (unsigned long long)LatencyHistogram_Percentile(histogram, 99),
+              (unsigned long long)histogram->maxMicroseconds);
+}
+
+void LatencyTrace_Begin(LatencyTrace *trace, const struct timespec *edgeTimestamp)
+{
+    trace->id = nextTraceId++;
+    trace->edge = *edgeTimestamp;
+    trace->send = *edgeTimestamp;
+    trace->queued = *edgeTimestamp;
+}
+
+void LatencyTrace_Submit(const LatencyTrace *trace)
+{
+    LatencyHistogram_Record(&histograms[LatencyTrace_Stage_EdgeToSend],
+                            LatencyTrace_ElapsedMicroseconds(&trace->edge, &trace->send));
+    LatencyHistogram_Record(&histograms[LatencyTrace_Stage_SendToQueued],
+                            LatencyTrace_ElapsedMicroseconds(&trace->send, &trace->queued));
+}
+
+void LatencyTrace_Complete(const LatencyTrace *trace, bool delivered)
+{
+    struct timespec now = LatencyTrace_Now();
+    if (delivered) {
+        LatencyHistogram_Record(&histograms[LatencyTrace_Stage_QueuedToDelivered],
+                                LatencyTrace_ElapsedMicroseconds(&trace->queued, &now));
+        LatencyHistogram_Record(&histograms[LatencyTrace_Stage_EdgeToDelivered],
+                                LatencyTrace_ElapsedMicroseconds(&trace->edge, &now));
+    } else {
+        failedDeliveries++;
+    }
+}
+
+const LatencyHistogram *LatencyTrace_GetHistogram(LatencyTrace_Stage stage)
+{
+    return &histograms[stage];
+}
+
+void LatencyTrace_LogSummary(void)
+{
+    for (int stage = 0; stage < LatencyTrace_Stage_Count; stage++) {
+        LatencyHistogram_LogSummary(stageNames[stage], &histograms[stage]);
+    }
+
+    if (failedDeliveries != 0) {
+        Log_Debug("INFO: Latency traces: %u failed deliveries.\n", failedDeliveries);
+    }
+}
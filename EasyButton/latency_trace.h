@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/// <summary>
+///     Number of buckets in a LatencyHistogram. Bucket 'i' counts samples in [2^(i-1), 2^i)
+///     microseconds, bucket 0 counts samples under 1 microsecond and the last bucket counts
+///     everything above the range.
+/// </summary>
+#define LATENCY_HISTOGRAM_BUCKETS 24
+
+/// <summary>
+///     Enumeration of the measured stages of the press-to-cloud path.
+/// </summary>
+typedef enum {
+    /// <summary>Edge detection to the handling of the press by the event loop.</summary>
+    LatencyTrace_Stage_EdgeToDispatch = 0,
+    /// <summary>Edge detection to the call to SendMessageToIotHub.</summary>
+    LatencyTrace_Stage_EdgeToSend,
+    /// <summary>
+    ///     SendMessageToIotHub to the return of AzureIoT_SendMessage for the batch carrying the
+    ///     message.
+    /// </summary>
+    LatencyTrace_Stage_SendToQueued,
+    /// <summary>Return of AzureIoT_SendMessage to the delivery confirmation.</summary>
+    LatencyTrace_Stage_QueuedToDelivered,
+    /// <summary>Edge detection to the delivery confirmation (press-to-hub).</summary>
+    LatencyTrace_Stage_EdgeToDelivered,
+    LatencyTrace_Stage_Count
+} LatencyTrace_Stage;
+
+/// <summary>
+///     Log2-bucketed latency histogram.
+/// </summary>
+typedef struct LatencyHistogram {
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+    uint32_t count;
+    uint64_t sumMicroseconds;
+    uint64_t minMicroseconds;
+    uint64_t maxMicroseconds;
+} LatencyHistogram;
+
+/// <summary>
+///     The timestamps collected for a single press as it travels to the IoT Hub.
+/// </summary>
+typedef struct LatencyTrace {
+    /// <summary>Identifier of the press, also sent to the IoT Hub with the message.</summary>
+    uint32_t id;
+    /// <summary>CLOCK_MONOTONIC time of the edge detection.</summary>
+    struct timespec edge;
+    /// <summary>CLOCK_MONOTONIC time at which SendMessageToIotHub was entered.</summary>
+    struct timespec send;
+    /// <summary>CLOCK_MONOTONIC time at which AzureIoT_SendMessage returned.</summary>
+    struct timespec queued;
+} LatencyTrace;
+
+/// <summary>
+///     Returns the current CLOCK_MONOTONIC time.
+/// </summary>
+struct timespec LatencyTrace_Now(void);
+
+/// <summary>
+///     Returns the number of microseconds elapsed from 'start' to 'end', or 0 if 'end' is
+///     before 'start'.
+/// </summary>
+uint64_t LatencyTrace_ElapsedMicroseconds(const struct timespec *start, const struct timespec *end);
+
+/// <summary>
+///     Adds a sample to a histogram.
+/// </summary>
+/// <param name="histogram">The histogram.</param>
+/// <param name="microseconds">The sample, in microseconds.</param>
+void LatencyHistogram_Record(LatencyHistogram *histogram, uint64_t microseconds);
+
+/// <summary>
+///     Returns an upper bound of the given percentile of a histogram, in microseconds.
+/// </summary>
+/// <param name="histogram">The histogram.</param>
+/// <param name="percentile">The percentile, from 0 to 100.</param>
+uint64_t LatencyHistogram_Percentile(const LatencyHistogram *histogram, unsigned int percentile);
+
+/// <summary>
+///     Records a sample of a stage that is not tied to a trace.
+/// </summary>
+/// <param name="stage">The stage.</param>
+/// <param name="start">CLOCK_MONOTONIC time at which the stage started.</param>
+/// <param name="end">CLOCK_MONOTONIC time at which the stage ended.</param>
+void LatencyTrace_Record(LatencyTrace_Stage stage, const struct timespec *start,
+                         const struct timespec *end);
+
+/// <summary>
+///     Logs a summary of a histogram.
+/// </summary>
+/// <param name="name">The name of the histogram.</param>
+/// <param name="histogram">The histogram.</param>
+void LatencyHistogram_LogSummary(const char *name, const LatencyHistogram *histogram);
+
+/// <summary>
+///     Starts a new trace for a press, allocating its trace ID.
+/// </summary>
+/// <param name="trace">The trace to initialize.</param>
+/// <param name="edgeTimestamp">CLOCK_MONOTONIC time of the edge detection.</param>
+void LatencyTrace_Begin(LatencyTrace *trace, const struct timespec *edgeTimestamp);
+
+/// <summary>
+///     Records the send stages of a trace whose message has just been handed to the IoT Hub
+///     SDK for the first time.
+/// </summary>
+/// <param name="trace">The trace, with its 'send' and 'queued' timestamps set.</param>
+void LatencyTrace_Submit(const LatencyTrace *trace);
+
+/// <summary>
+///     Records the delivery stages of a submitted trace once the outcome of its message is
+///     known; the outbound queue matches confirmations to the messages they are for.
+/// </summary>
+/// <param name="trace">The trace.</param>
+/// <param name="delivered">Whether the IoT Hub confirmed delivery of the message.</param>
+void LatencyTrace_Complete(const LatencyTrace *trace, bool delivered);
+
+/// <summary>
+///     Returns the histogram of a stage.
+/// </summary>
+const LatencyHistogram *LatencyTrace_GetHistogram(LatencyTrace_Stage stage);
+
+/// <summary>
+///     Logs a summary of all stage histograms.
+/// </summary>
+void LatencyTrace_LogSummary(void);
@@ -0,0 +1,228 @@
+#include <string.h>
+#include <time.h>
+
+#include <applibs/log.h>
+
+#include "epoll_timerfd_utilities.h"
+#include "led_animation.h"
+
+typedef struct AnimatedLed {
+    RgbLed *led;
+    const LedAnimation_Sequence *sequence;
+    struct timespec start;
+    bool playing;
+    RgbLedPwm_Levels shownLevels;
+    bool shown;
+} AnimatedLed;
+
+static AnimatedLed animatedLeds[RGBLED_PWM_MAX_LEDS];
+static size_t animatedLedCount = 0;
+
+static int frameTimerFd = -1;
+static bool frameClockRunning = false;
+
+static void FrameClockHandler(event_data_t *eventData);
+static event_data_t frameClockEventData = {.eventHandler = &FrameClockHandler};
+
+static uint64_t ElapsedMilliseconds(const struct timespec *start, const struct timespec *end)
+{
+    int64_t nanoseconds = (int64_t)(end->tv_sec - start->tv_sec) * 1000000000LL +
+                          (end->tv_nsec - start->tv_nsec);
+    return nanoseconds > 0 ? (uint64_t)nanoseconds / 1000000 : 0;
+}
+
+static uint8_t Interpolate(uint8_t from, uint8_t to, uint32_t progress)
+{
+    // 'progress' is in 1/65536ths of the transition.
+    return (uint8_t)(from + (((int32_t)to - from) * (int32_t)(progress >> 8) >> 8));
+}
+
+/// <summary>
+///     Returns the levels of a sequence 'elapsedMs' after it started.
+/// </summary>
+/// <param name="finished">Set to true when the sequence has been played 'repeat' times.</param>
+static RgbLedPwm_Levels SequenceLevels(const LedAnimation_Sequence *sequence, uint64_t elapsedMs,
+                                       bool *finished)
+{
+    const LedAnimation_Keyframe *keyframes = sequence->keyframes;
+    size_t count = sequence->keyframeCount;
+
+    uint64_t totalMs = 0;
+    for (size_t i = 0; i < count; i++) {
+        totalMs += keyframes[i].durationMs;
+    }
+
+    if (totalMs == 0 || (sequence->repeat != 0 && elapsedMs >= totalMs * sequence->repeat)) {
+        *finished = true;
+        return keyframes[count - 1].levels;
+    }
+
+    *finished = false;
+    uint64_t offsetMs = elapsedMs % totalMs;
+    size_t index = 0;
+    while (offsetMs >= keyframes[index].durationMs) {
+        offsetMs -= keyframes[index].durationMs;
+        index++;
+    }
+
+    const LedAnimation_Keyframe *current = &keyframes[index];
+    if (current->easing == LedAnimation_Easing_Step) {
+        return current->levels;
+    }
+
+    // The last keyframe fades to the first one when the sequence repeats, or holds otherwise.
+    const LedAnimation_Keyframe *next = &keyframes[(index + 1) % count];
+    if (index + 1 == count && sequence->repeat == 1) {
+        next = current;
+    }
+
+    uint32_t progress = (uint32_t)((offsetMs << 16) / current->durationMs);
+    if (current->easing == LedAnimation_Easing_EaseInOut) {
+        // Smoothstep: 3p^2 - 2p^3, in 16-bit fixed point.
+        uint64_t p = progress;
+        progress = (uint32_t)((3 * p * p - ((2 * p * p * p) >> 16)) >> 16);
+    }
+
+    RgbLedPwm_Levels levels = {Interpolate(current->levels.red, next->levels.red, progress),
+                               Interpolate(current->levels.green, next->levels.green, progress),
+                               Interpolate(current->levels.blue, next->levels.blue, progress)};
+    return levels;
+}
+
+/// <summary>
+///     Shows levels on a LED. Levels that are a plain color are requested, to be written with
+///     the other LEDs by the next render; other levels are handed to the PWM engine.
+/// </summary>
+static void ShowLevels(size_t ledIndex, const RgbLedPwm_Levels *levels)
+{
+    AnimatedLed *animated = &animatedLeds[ledIndex];
+    if (animated->shown && memcmp(&animated->shownLevels, levels, sizeof(*levels)) == 0) {
+        return;
+    }
+
+    RgbLedUtility_Colors color = RgbLedUtility_GetColorFromRgb(levels);
+    if (color != RgbLedUtility_Colors_Unknown) {
+        RgbLedPwm_Release(ledIndex);
+        RgbLedUtility_RequestLed(animated->led, color);
+    } else {
+        RgbLedPwm_SetLevels(ledIndex, levels);
+    }
+
+    animated->shownLevels = *levels;
+    animated->shown = true;
+}
+
+/// <summary>
+///     Advances every playing animation to 'now'.
+/// </summary>
+/// <returns>true if an animation is still playing, false otherwise.</returns>
+static bool AdvanceAnimations(const struct timespec *now)
+{
+    bool anyPlaying = false;
+
+    for (size_t i = 0; i < animatedLedCount; i++) {
+        AnimatedLed *animated = &animatedLeds[i];
+        if (!animated->playing) {
+            continue;
+        }
+
+        bool finished;
+        RgbLedPwm_Levels levels = SequenceLevels(
+            animated->sequence, ElapsedMilliseconds(&animated->start, now), &finished);
+        ShowLevels(i, &levels);
+
+        animated->playing = !finished;
+        anyPlaying = anyPlaying || animated->playing;
+    }
+
+    return anyPlaying;
+}
+
+static void SetFrameClockRunning(bool running)
+{
+    if (running == frameClockRunning) {
+        return;
+    }
+
+    static const struct timespec framePeriod = {0, LED_ANIMATION_FRAME_PERIOD_MS * 1000000};
+    static const struct timespec stopped = {0, 0};
+    SetTimerFdToPeriod(frameTimerFd, running ? &framePeriod : &stopped);
+    frameClockRunning = running;
+}
+
+static void FrameClockHandler(event_data_t *eventData)
+{
+    if (ConsumeTimerFdEvent(frameTimerFd) != 0) {
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    SetFrameClockRunning(AdvanceAnimations(&now));
+}
+
+int LedAnimation_Init(int epollFd, RgbLed **leds, size_t ledCount)
+{
+    if (ledCount > RGBLED_PWM_MAX_LEDS) {
+        Log_Debug("ERROR: Cannot animate more than %d RGB LEDs.\n", RGBLED_PWM_MAX_LEDS);
+        return -1;
+    }
+
+    for (size_t i = 0; i < ledCount; i++) {
+        animatedLeds[i] = (AnimatedLed){.led = leds[i]};
+    }
+    animatedLedCount = ledCount;
+
+    static const struct timespec nullPeriod = {0, 0};
+    frameTimerFd = CreateTimerFdAndAddToEpoll(epollFd, &nullPeriod, &frameClockEventData, EPOLLIN);
+    if (frameTimerFd < 0) {
+        return -1;
+    }
+
+    frameClockRunning = false;
+    return 0;
+}
+
+int LedAnimation_Play(size_t ledIndex, const LedAnimation_Sequence *sequence)
+{
+    if (ledIndex >= animatedLedCount || sequence->keyframeCount == 0) {
+        Log_Debug("ERROR: Cannot play animation on LED %zu.\n", ledIndex);
+        return -1;
+    }
+
+    AnimatedLed *animated = &animatedLeds[ledIndex];
+    animated->sequence = sequence;
+    animated->playing = true;
+    // The LED may have been written outside of the animation engine since the last frame.
+    animated->shown = false;
+    clock_gettime(CLOCK_MONOTONIC, &animated->start);
+
+    // Show the first frame now rather than on the next tick of the frame clock.
+    bool finished;
+    RgbLedPwm_Levels levels = SequenceLevels(sequence, 0, &finished);
+    ShowLevels(ledIndex, &levels);
+    animated->playing = !finished;
+
+    if (animated->playing) {
+        SetFrameClockRunning(true);
+    }
+    return 0;
+}
+
+void LedAnimation_Stop(size_t ledIndex)
+{
+    if (ledIndex < animatedLedCount) {
+        animatedLeds[ledIndex].playing = false;
+    }
+}
+
+void LedAnimation_Close(void)
+{
+    for (size_t i = 0; i < animatedLedCount; i++) {
+        animatedLeds[i].playing = false;
+    }
+    CloseFdAndPrintError(frameTimerFd, "AnimationFrameTimer");
+    frameTimerFd = -1;
+    frameClockRunning = false;
+    animatedLedCount = 0;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rgbled_pwm.h"
+#include "rgbled_utility.h"
+
+/// <summary>
+///     Period of the animation frame clock, in milliseconds (50 Hz).
+/// </summary>
+#define LED_ANIMATION_FRAME_PERIOD_MS 20
+
+/// <summary>
+///     How a keyframe transitions to the next one.
+/// </summary>
+typedef enum {
+    /// <summary>Hold the keyframe levels for its whole duration.</summary>
+    LedAnimation_Easing_Step = 0,
+    /// <summary>Fade linearly to the levels of the next keyframe.</summary>
+    LedAnimation_Easing_Linear = 1,
+    /// <summary>Fade to the levels of the next keyframe, slow at both ends.</summary>
+    LedAnimation_Easing_EaseInOut = 2
+} LedAnimation_Easing;
+
+/// <summary>
+///     A step of an animation.
+/// </summary>
+typedef struct LedAnimation_Keyframe {
+    /// <summary>The levels of the LED at the start of the keyframe.</summary>
+    RgbLedPwm_Levels levels;
+    /// <summary>How long the keyframe lasts, in milliseconds.</summary>
+    uint32_t durationMs;
+    /// <summary>How the keyframe transitions to the next one.</summary>
+    LedAnimation_Easing easing;
+} LedAnimation_Keyframe;
+
+/// <summary>
+///     A sequence of keyframes played on a LED.
+/// </summary>
+typedef struct LedAnimation_Sequence {
+    const LedAnimation_Keyframe *keyframes;
+    size_t keyframeCount;
+    /// <summary>
+    ///     Number of times the sequence is played, or 0 to repeat it forever. Once played, the
+    ///     LED holds the levels of the last keyframe.
+    /// </summary>
+    uint32_t repeat;
+} LedAnimation_Sequence;
+
+/// <summary>
+///     Keyframe levels of each of the RgbLedUtility_Colors.
+/// </summary>
+#define LED_ANIMATION_LEVELS_OFF {0, 0, 0}
+#define LED_ANIMATION_LEVELS_RED {255, 0, 0}
+#define LED_ANIMATION_LEVELS_GREEN {0, 255, 0}
+#define LED_ANIMATION_LEVELS_BLUE {0, 0, 255}
+#define LED_ANIMATION_LEVELS_YELLOW {255, 255, 0}
+#define LED_ANIMATION_LEVELS_CYAN {0, 255, 255}
+#define LED_ANIMATION_LEVELS_MAGENTA {255, 0, 255}
+#define LED_ANIMATION_LEVELS_WHITE {255, 255, 255}
+
+/// <summary>
+///     Initializes the animation engine for the given LEDs, which must be the LEDs given to
+///     RgbLedPwm_Init, in the same order. All animations advance from a single frame clock,
+///     registered on the given epoll instance, which only runs while an animation is playing.
+///     Plain colors are requested with RgbLedUtility_RequestLed, and written by the next
+///     RgbLedUtility_RenderLeds.
+/// </summary>
+/// <param name="epollFd">The epoll instance on which the frame clock is registered.</param>
+/// <param name="leds">The LEDs that can be animated.</param>
+/// <param name="ledCount">The number of LEDs.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int LedAnimation_Init(int epollFd, RgbLed **leds, size_t ledCount);
+
+/// <summary>
+///     Starts playing a sequence on a LED, replacing any sequence it was playing. The first
+///     keyframe is shown immediately.
+/// </summary>
+/// <param name="ledIndex">Index of the LED in the array given to LedAnimation_Init.</param>
+/// <param name="sequence">The sequence. It must stay in memory while it is played.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int LedAnimation_Play(size_t ledIndex, const LedAnimation_Sequence *sequence);
+
+/// <summary>
+///     Stops the sequence played on a LED, leaving the LED as it is.
+/// </summary>
+/// <param name="ledIndex">Index of the LED in the array given to LedAnimation_Init.</param>
+void LedAnimation_Stop(size_t ledIndex);
+
+/// <summary>
+///     Stops all animations and closes the frame clock.
+/// </summary>
+void LedAnimation_Close(void);
@@ -1,6 +1,7 @@
 ﻿#include <errno.h>
 #include <signal.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 // applibs_versions.h defines the API struct versions to use for applibs APIs.
@@ -11,7 +12,19 @@
 #include <applibs/log.h>
 #include <applibs/wificonfig.h>
 
+#include "button_event_queue.h"
+#include "desired_properties.h"
+#include "direct_method.h"
+#include "do_work_scheduler.h"
+#include "input_scanner.h"
+#include "led_animation.h"
+#include "latency_trace.h"
+#include "message_log.h"
 #include "mt3620_rdb.h"
+#include "outbound_queue.h"
+#include "press_aggregator.h"
+#include "reported_properties.h"
+#include "rgbled_pwm.h"
 #include "rgbled_utility.h"
 
 // This sample C application for a MT3620 Reference Development Board (Azure Sphere) demonstrates how to
@@ -27,10 +40,19 @@
 // - Device Twin management;
 //
 // A description of the sample follows:
-// - LED 1 blinks constantly.
-// - Pressing button A toggles the rate at which LED 1 blinks
-//   between three values.
-// - Pressing button B triggers the sending of a message to the IoT Hub.
+// - LED 1 shows the state of the easy button: blue once armed, red when its press is sent or
+//   a batch of messages fails, and green once the IoT Hub confirms a delivery.
+// - Buttons are sampled every millisecond. Passing "--busy-poll" in the CmdArgs of the app
+//   manifest instead polls them continuously from a dedicated thread, for the lowest possible
+//   press latency at the cost of one core.
+// - Pressing button A arms the easy button.
+// - Pressing button B triggers the sending of a message to the IoT Hub. Presses that follow
+//   within the aggregation window are counted into one more message, sent when it ends.
+// - Messages are queued and sent to the IoT Hub in batches, as one JSON array, once the batch
+//   is full or its oldest message is a second old.
+// - Messages sent while the IoT Hub is not reachable are kept in a log in mutable storage,
+//   which survives restarts, and are sent in order once the connection is established. They
+//   stay in the log until the IoT Hub confirms their delivery.
 // - LED 2 flashes red when button B is pressed (and a
 //   message is sent) and flashes yellow when a message is received.
 // - LED 3 indicates whether network connection to the Azure IoT Hub has been
@@ -38,15 +60,14 @@
 //
 // Direct Method related notes:
 // - Invoking the method named "LedColorControlMethod" with a payload containing '{"color":"red"}'
-//   will set the color of LED 1 to red;
+//   will set the color of LED 1 to red until the state of the easy button next changes; the
+//   color may also be given as "#rrggbb" or "rgb(r,g,b)";
 //
 // Device Twin related notes:
-// - Setting LedBlinkRateProperty in the Device Twin to a value from 0 to 2 causes the sample to
-//   update the blink rate of LED 1 accordingly, e.g '{"LedBlinkRateProperty": 2}';
+// - LedBlinkRateProperty accepts a value from 0 to 2, e.g '{"LedBlinkRateProperty": 2}'. No LED
+//   blinks, as LED 1 shows the state of the easy button; the value is only kept.
 // - Upon receipt of the LedBlinkRateProperty desired value from the IoT hub, the sample updates
 //   the device twin on the IoT hub with the new value for LedBlinkRateProperty.
-// - Pressing button A causes the sample to report the blink rate to the device
-//   twin on the IoT Hub.
 
 // This sample uses the API for the following Azure Sphere application libraries:
 // - gpio (digital input for button);
@@ -66,22 +87,16 @@
 static const GPIO_Id ledsPins[3][3] = {
     {MT3620_RDB_LED1_RED, MT3620_RDB_LED1_GREEN, MT3620_RDB_LED1_BLUE}, {MT3620_RDB_LED2_RED, MT3620_RDB_LED2_GREEN, MT3620_RDB_LED2_BLUE}, {MT3620_RDB_LED3_RED, MT3620_RDB_LED3_GREEN, MT3620_RDB_LED3_BLUE}};
 
-static size_t blinkIntervalIndex = 0;
-static RgbLedUtility_Colors ledBlinkColor = RgbLedUtility_Colors_Blue;
-
-static const struct timespec blinkIntervals[] = {{0, 125000000}, {0, 250000000}, {0, 500000000}};
-static const size_t blinkIntervalsCount = sizeof(blinkIntervals) / sizeof(*blinkIntervals);
+// The value of LedBlinkRateProperty, from 0 to LED_BLINK_RATE_COUNT - 1.
+static size_t ledBlinkRate = 0;
+#define LED_BLINK_RATE_COUNT 3
 
 // File descriptors - initialized to invalid value
 static int epollFd = -1;
-static int gpioLedBlinkRateButtonFd = -1;
-static int gpioSendMessageButtonFd = -1;
 static int gpioButtonsManagementTimerFd = -1;
-static int gpioLed1TimerFd = -1;
-static int gpioLed2TimerFd = -1;
 static int azureIotDoWorkTimerFd = -1;
-
-static int gpioEasyButtonFd = -1;
+static int buttonEventsFd = -1;
+static int pressAggregationTimerFd = -1;
 
 // LED state
 static RgbLed led1 = RGBLED_INIT_VALUE;
@@ -89,14 +104,104 @@ static RgbLed led2 = RGBLED_INIT_VALUE;
 static RgbLed led3 = RGBLED_INIT_VALUE;
 static RgbLed *rgbLeds[] = {&led1, &led2, &led3};
 static const size_t rgbLedsCount = sizeof(rgbLeds) / sizeof(*rgbLeds);
-
-// Default blinking rate of LED1
-static struct timespec blinkingLedPeriod = {0, 125000000};
-static bool blinkingLedState;
+static const size_t led1Index = 0;
+static const size_t led2Index = 1;
+static const size_t led3Index = 2;
+
+// LED animations.
+static const LedAnimation_Keyframe flashRedKeyframes[] = {
+    {.levels = LED_ANIMATION_LEVELS_RED, .durationMs = 150, .easing = LedAnimation_Easing_Step},
+    {.levels = LED_ANIMATION_LEVELS_OFF, .durationMs = 0, .easing = LedAnimation_Easing_Step}};
+static const LedAnimation_Sequence flashRedOnce = {
+    .keyframes = flashRedKeyframes, .keyframeCount = 2, .repeat = 1};
+static const LedAnimation_Keyframe solidRedKeyframes[] = {
+    {.levels = LED_ANIMATION_LEVELS_RED, .durationMs = 0, .easing = LedAnimation_Easing_Step}};
+static const LedAnimation_Sequence solidRed = {
+    .keyframes = solidRedKeyframes, .keyframeCount = 1, .repeat = 1};
+static const LedAnimation_Keyframe solidGreenKeyframes[] = {
+    {.levels = LED_ANIMATION_LEVELS_GREEN, .durationMs = 0, .easing = LedAnimation_Easing_Step}};
+static const LedAnimation_Sequence solidGreen = {
+    .keyframes = solidGreenKeyframes, .keyframeCount = 1, .repeat = 1};
+static const LedAnimation_Keyframe solidOffKeyframes[] = {
+    {.levels = LED_ANIMATION_LEVELS_OFF, .durationMs = 0, .easing = LedAnimation_Easing_Step}};
+static const LedAnimation_Sequence solidOff = {
+    .keyframes = solidOffKeyframes, .keyframeCount = 1, .repeat = 1};
+static const LedAnimation_Keyframe solidBlueKeyframes[] = {
+    {.levels = LED_ANIMATION_LEVELS_BLUE, .durationMs = 0, .easing = LedAnimation_Easing_Step}};
+static const LedAnimation_Sequence solidBlue = {
+    .keyframes = solidBlueKeyframes, .keyframeCount = 1, .repeat = 1};
+// The color set by LedColorControlMethod.
+static LedAnimation_Keyframe solidControlColorKeyframes[] = {
+    {.levels = LED_ANIMATION_LEVELS_OFF, .durationMs = 0, .easing = LedAnimation_Easing_Step}};
+static const LedAnimation_Sequence solidControlColor = {
+    .keyframes = solidControlColorKeyframes, .keyframeCount = 1, .repeat = 1};
 
 // A null period to not start the timer when it is created with CreateTimerFdAndAddToEpoll.
 static const struct timespec nullPeriod = {0, 0};
-static const struct timespec defaultBlinkTimeLed2 = {0, 150 * 1000 * 1000};
+
+// The buttons: button A, button B and the easy button on header 1, pin 4. The easy button reads
+// high while pressed and ignores changes within 450 ms of the last one.
+static const InputScanner_InputConfig buttonInputs[] = {
+    {.gpioId = MT3620_RDB_BUTTON_A,
+     .input = ButtonEvent_Input_ButtonA,
+     .pressedValue = GPIO_Value_Low,
+     .holdOff = {0, 0}},
+    {.gpioId = MT3620_RDB_BUTTON_B,
+     .input = ButtonEvent_Input_ButtonB,
+     .pressedValue = GPIO_Value_Low,
+     .holdOff = {0, 0}},
+    {.gpioId = MT3620_RDB_HEADER1_PIN4_GPIO,
+     .input = ButtonEvent_Input_EasyButton,
+     .pressedValue = GPIO_Value_High,
+     .holdOff = {0, 450 * 1000 * 1000}}};
+static const size_t buttonInputsCount = sizeof(buttonInputs) / sizeof(*buttonInputs);
+
+// When set, the buttons are polled continuously from a dedicated thread instead of by the
+// buttons timer.
+static bool busyPollInput = false;
+
+// Presses detected by the input scanner, waiting to be handled by ButtonEventsHandler.
+static ButtonEventQueue buttonEvents;
+static bool easyButtonArmed = false;
+
+// An armed press is sent right away, presses within its aggregation window are sent as a single
+// message when the window ends, and no more than one message is sent per emission interval.
+static const PressAggregator_Config pressAggregatorConfig = {.window = {0, 500 * 1000 * 1000},
+                                                             .minEmitInterval = {2, 0}};
+static PressAggregator pressAggregator;
+static LatencyTrace pressBurstTrace;
+
+// Press messages are sent as soon as they are queued. Telemetry and diagnostics are sent in
+// batches of up to 8 messages or 1 KiB, no later than 1 s (telemetry) or 5 s (diagnostics)
+// after the first message of the batch was queued, and only while few batches await a
+// confirmation, so that they never hold a press back for long. A batch that is not delivered,
+// or not confirmed within 10 s, is sent up to three times.
+static const OutboundQueue_Config outboundQueueConfig = {
+    .maxAttempts = 3,
+    .confirmationTimeout = {10, 0},
+    .lanes = {[OutboundQueue_Lane_Interactive] = {.maxBatchSize = 1024,
+                                                  .maxMessageCount = 8,
+                                                  .maxAge = {0, 0},
+                                                  .maxInFlight = OUTBOUND_QUEUE_MAX_IN_FLIGHT},
+              [OutboundQueue_Lane_Telemetry] = {.maxBatchSize = 1024,
+                                                .maxMessageCount = 8,
+                                                .maxAge = {1, 0},
+                                                .maxInFlight = 2},
+              [OutboundQueue_Lane_Diagnostics] = {.maxBatchSize = 1024,
+                                                  .maxMessageCount = 8,
+                                                  .maxAge = {5, 0},
+                                                  .maxInFlight = 1}}};
+
+// The IoT Hub SDK's DoWork runs as soon as something was handed to it, every 10 ms while
+// confirmations are awaited, so that they are handled close to their arrival, and otherwise
+// backs off from 100 ms to once a second while idle.
+static const DoWorkScheduler_Config doWorkSchedulerConfig = {
+    .minIdlePeriod = {0, 100 * 1000 * 1000},
+    .maxIdlePeriod = {1, 0},
+    .confirmationPeriod = {0, 10 * 1000 * 1000}};
+
+// Changes to the reported properties are collected for 250 ms and reported together.
+static const struct timespec reportedPropertiesFlushDelay = {0, 250 * 1000 * 1000};
 
 // Connectivity state
 static bool connectedToIoTHub = false;
@@ -136,61 +241,98 @@ static void DebugPrintCurrentlyConnectedWiFiNetwork(void)
 /// </summary>
 static void BlinkLed2Once(void)
 {
-    RgbLedUtility_SetLed(&led2, RgbLedUtility_Colors_Red);
-    SetTimerFdToSingleExpiry(gpioLed2TimerFd, &defaultBlinkTimeLed2);
+    LedAnimation_Play(led2Index, &flashRedOnce);
 }
 
 /// <summary>
-///     Helper function to open a file descriptor for the given GPIO as input mode.
+///     Reports the value of LedBlinkRateProperty to the device twin.
 /// </summary>
-/// <param name="gpioId">The GPIO to open.</param>
-/// <param name="outGpioFd">File descriptor of the opened GPIO.</param>
-/// <returns>True if successful, false if an error occurred.</return>
-static bool OpenGpioFdAsInput(GPIO_Id gpioId, int *outGpioFd)
+static void ReportLedBlinkRate(void)
 {
-    *outGpioFd = GPIO_OpenAsInput(gpioId);
-    if (*outGpioFd < 0) {
-        Log_Debug("ERROR: Could not open GPIO '%d': %d (%s).\n", gpioId, errno, strerror(errno));
+    ReportedProperties_Stage("LedBlinkRateProperty", ledBlinkRate);
+}
+
+/// <summary>
+///     Reports a property to the Device Twin on the IoT Hub.
+/// </summary>
+/// <param name="name">The name of the property.</param>
+/// <param name="value">The value of the property.</param>
+/// <returns>true if the property was reported, false otherwise.</returns>
+static bool ReportPropertyToIotHub(const char *name, size_t value)
+{
+    if (!connectedToIoTHub) {
+        Log_Debug("WARNING: Cannot send reported property; not connected to the IoT Hub.\n");
         return false;
     }
 
+    AzureIoT_TwinReportState(name, value);
+    DoWorkScheduler_RequestNow();
     return true;
 }
 
 /// <summary>
-///     Toggles the blink speed of the blink LED between 3 values, and updates the device twin.
+///     Sends a batch of queued messages to the IoT Hub.
 /// </summary>
-/// <param name="rate">The blink rate</param>
-static void SetLedRate(const struct timespec *rate)
+/// <param name="batch">The messages, as a JSON array.</param>
+/// <returns>true if the batch was handed to the IoT Hub SDK, false otherwise.</returns>
+static bool SendBatchToIotHub(const char *batch)
 {
-    if (SetTimerFdToPeriod(gpioLed1TimerFd, rate) != 0) {
-        Log_Debug("ERROR: could not set the period of the LED.\n");
-        terminationRequired = true;
-        return;
+    if (!connectedToIoTHub) {
+        return false;
     }
 
-    if (connectedToIoTHub) {
-        // Report the current state to the Device Twin on the IoT Hub.
-        AzureIoT_TwinReportState("LedBlinkRateProperty", blinkIntervalIndex);
-    } else {
-        Log_Debug("WARNING: Cannot send reported property; not connected to the IoT Hub.\n");
+    AzureIoT_SendMessage(batch);
+    DoWorkScheduler_RequestNow();
+
+    // Set the send/receive LED2 to blink once immediately to indicate the messages have been
+    // queued.
+    BlinkLed2Once();
+    return true;
+}
+
+/// <summary>
+///     Queues a logged message to be sent to the IoT Hub, behind the messages of the user.
+/// </summary>
+/// <param name="payload">The message.</param>
+/// <param name="length">The length of the message.</param>
+/// <param name="sequence">The sequence number of the message in the log.</param>
+/// <returns>true if the message was queued, false otherwise.</returns>
+static bool QueueLoggedMessage(const char *payload, size_t length, uint32_t sequence)
+{
+    // Stop the replay at a message that would send the batch before it is complete. The batch
+    // carries the sequence number of its last message, so that it is committed once the batch
+    // is delivered.
+    if (OutboundQueue_GetQueuedCount(OutboundQueue_Lane_Telemetry) != 0 &&
+        !OutboundQueue_FitsInBatch(OutboundQueue_Lane_Telemetry, length)) {
+        return false;
     }
+    return OutboundQueue_Enqueue(OutboundQueue_Lane_Telemetry, payload, length, NULL, sequence) ==
+           0;
 }
 
 /// <summary>
-///     Sends a message to the IoT Hub.
+///     Queues a press message to be sent to the IoT Hub ahead of any telemetry, or logs it until
+///     the IoT Hub is reachable.
 /// </summary>
-static void SendMessageToIotHub(const char *messagePayload)
+/// <param name="messagePayload">The payload of the message, a JSON value.</param>
+/// <param name="messageLength">The length of the payload.</param>
+/// <param name="trace">The latency trace of the press that caused the message.</param>
+static void SendMessageToIotHub(const char *messagePayload, size_t messageLength,
+                                LatencyTrace *trace)
 {
+    trace->send = LatencyTrace_Now();
+
     if (connectedToIoTHub) {
-        // Send a message
-        AzureIoT_SendMessage(messagePayload);
+        OutboundQueue_Enqueue(OutboundQueue_Lane_Interactive, messagePayload, messageLength,
+                              trace, 0);
 
-        // Set the send/receive LED2 to blink once immediately to indicate the message has been
-        // queued.
-        BlinkLed2Once();
-    } else {
-        Log_Debug("WARNING: Cannot send message: not connected to the IoT Hub.\n");
+        // Make sure DoWork runs when the batch is due.
+        struct timespec flushDeadline;
+        if (OutboundQueue_GetFlushDeadline(&flushDeadline)) {
+            DoWorkScheduler_RequestBy(&flushDeadline);
+        }
+    } else if (MessageLog_Append(messagePayload, messageLength) == 0) {
+        Log_Debug("INFO: Message %u logged until it can be sent to the IoT Hub.\n", trace->id);
     }
 }
 
@@ -200,10 +342,37 @@ static void SendMessageToIotHub(const char *messagePayload)
 /// <param name="payload">The payload of the received message.</param>
 static void MessageReceived(const char *payload)
 {
+    DoWorkScheduler_NotifyActivity();
+
     // Set the send/receive LED2 to blink once immediately to indicate a message has been received.
     BlinkLed2Once();
 }
 
+/// <summary>
+///     Handler of the LedBlinkRateProperty desired property.
+/// </summary>
+/// <param name="value">The desired blink rate, from 0 to LED_BLINK_RATE_COUNT - 1.</param>
+static void LedBlinkRatePropertyChanged(const DesiredProperties_Value *value)
+{
+    ledBlinkRate = (size_t)value->number;
+
+    Log_Debug("INFO: Received desired value %zu for LedBlinkRateProperty.\n", ledBlinkRate);
+
+    ReportLedBlinkRate();
+}
+
+// The desired properties of the Device Twin: the type and range of their values, and their
+// handlers. The hash of each name is its 32-bit FNV-1a hash.
+static const DesiredProperties_Property desiredPropertyTable[] = {
+    {.name = "LedBlinkRateProperty",
+     .nameHash = 0x7881f3bf,
+     .type = DesiredProperties_Type_Number,
+     .minimum = 0,
+     .maximum = LED_BLINK_RATE_COUNT - 1,
+     .handler = &LedBlinkRatePropertyChanged}};
+static const size_t desiredPropertyCount =
+    sizeof(desiredPropertyTable) / sizeof(*desiredPropertyTable);
+
 /// <summary>
 ///     Device Twin update callback function, called when an update is received from the Azure IoT
 ///     Hub.
@@ -212,51 +381,68 @@ static void MessageReceived(const char *payload)
 /// properties received from the Azure IoT Hub.</param>
 static void DeviceTwinUpdate(JSON_Object *desiredProperties)
 {
-    JSON_Value *blinkRateJson = json_object_get_value(desiredProperties, "LedBlinkRateProperty");
-
-    // If the attribute is missing or its type is not a number.
-    if (blinkRateJson == NULL) {
-        Log_Debug(
-            "INFO: A device twin update was received that did not contain the property "
-            "\"LedBlinkRateProperty\".\n");
-    } else if (json_value_get_type(blinkRateJson) != JSONNumber) {
-        Log_Debug(
-            "INFO: Device twin desired property \"LedBlinkRateProperty\" was received with "
-            "incorrect type; it must be an integer.\n");
-    } else {
-        // Get the value of the LedBlinkRateProperty and print it.
-        size_t desiredBlinkRate = (size_t)json_value_get_number(blinkRateJson);
-
-        blinkIntervalIndex =
-            desiredBlinkRate % blinkIntervalsCount; // Clamp value to [0..blinkIntervalsCount) .
-
-        Log_Debug("INFO: Received desired value %zu for LedBlinkRateProperty, setting it to %zu.\n",
-                  desiredBlinkRate, blinkIntervalIndex);
-
-        blinkingLedPeriod = blinkIntervals[blinkIntervalIndex];
-        SetLedRate(&blinkIntervals[blinkIntervalIndex]);
-    }
+    DoWorkScheduler_NotifyActivity();
+    DesiredProperties_Update(desiredProperties);
 }
 
+// Direct method responses.
+static const DirectMethodResponse_Template colorOkResponse = DIRECT_METHOD_RESPONSE_TEMPLATE(
+    "{ \"success\" : true, \"message\" : \"led color set to ", "\" }");
+static const DirectMethodResponse_Template noColorResponse = DIRECT_METHOD_RESPONSE_TEMPLATE(
+    "{ \"success\" : false, \"message\" : \"request does not contain an identifiable color\" }",
+    "");
+
 /// <summary>
-///     Allocates and formats a string message on the heap.
+///     Handler of the "LedColorControlMethod" direct method, whose payload contains JSON such as
+///     { "color": "red"}, { "color": "#ff8000"} or { "color": "rgb(255,128,0)"}.
 /// </summary>
-/// <param name="messageFormat">The format of the message</param>
-/// <param name="maxLength">The maximum length of the formatted message string</param>
-/// <returns>The pointer to the heap allocated memory.</returns>
-static void *SetupHeapMessage(const char *messageFormat, size_t maxLength, ...)
+/// <param name="values">The "color" field of the payload.</param>
+/// <param name="responsePayload">The response payload content.</param>
+/// <param name="responsePayloadSize">The size of the response payload content.</param>
+/// <returns>200 HTTP status code if the color is correctly parsed;
+/// 400 HTTP status code is the color has not been recognised.</returns>
+static int LedColorControlMethod(const DirectMethod_Value *values, char **responsePayload,
+                                 size_t *responsePayloadSize)
 {
-    va_list args;
-    va_start(args, maxLength);
-    char *message =
-        malloc(maxLength + 1); // Ensure there is space for the null terminator put by vsnprintf.
-    if (message != NULL) {
-        vsnprintf(message, maxLength, messageFormat, args);
-    }
-    va_end(args);
-    return message;
+    RgbLedUtility_Rgb ledColor;
+
+    // If color has not been identified.
+    if (!RgbLedUtility_ParseColor(values[0].string, values[0].stringLength, &ledColor)) {
+        Log_Debug("INFO: Unrecognised direct method payload format.\n");
+        DirectMethod_Respond(&noColorResponse, NULL, responsePayload, responsePayloadSize);
+        return 400; // Bad request.
+    }
+
+    // Color has been identified: describe it by name, or as #rrggbb if it has none.
+    char colorHex[sizeof("#rrggbb")];
+    const char *colorString = colorHex;
+    RgbLedUtility_Colors namedColor = RgbLedUtility_GetColorFromRgb(&ledColor);
+    if (namedColor != RgbLedUtility_Colors_Unknown) {
+        colorString = RgbLedUtility_GetStringFromColor(namedColor);
+    } else {
+        snprintf(colorHex, sizeof(colorHex), "#%02x%02x%02x", ledColor.red, ledColor.green,
+                 ledColor.blue);
+    }
+    Log_Debug("INFO: LED color set to: '%s'.\n", colorString);
+    // Show the color on LED 1 until the state of the easy button next changes.
+    solidControlColorKeyframes[0].levels = ledColor;
+    LedAnimation_Play(led1Index, &solidControlColor);
+
+    DirectMethod_Respond(&colorOkResponse, colorString, responsePayload, responsePayloadSize);
+    return 200;
 }
 
+// The direct methods, and the payload fields each of them accepts.
+static const DirectMethod_Field ledColorControlFields[] = {
+    {.name = "color", .type = DirectMethod_FieldType_String, .required = true}};
+static const DirectMethod_Registration directMethods[] = {
+    {.name = "LedColorControlMethod",
+     .fields = ledColorControlFields,
+     .fieldCount = sizeof(ledColorControlFields) / sizeof(*ledColorControlFields),
+     .handler = &LedColorControlMethod,
+     .invalidPayloadResponse = &noColorResponse}};
+static const size_t directMethodsCount = sizeof(directMethods) / sizeof(*directMethods);
+
 /// <summary>
 ///     Direct Method callback function, called when a Direct Method call is received from the Azure
 ///     IoT Hub.
@@ -266,105 +452,82 @@ static void *SetupHeapMessage(const char *messageFormat, size_t maxLength, ...)
 /// <param name="responsePayload">The response payload content. This must be a heap-allocated
 /// string, 'free' will be called on this buffer by the Azure IoT Hub SDK.</param>
 /// <param name="responsePayloadSize">The size of the response payload content.</param>
-/// <returns>200 HTTP status code if the method name is "LedColorControlMethod" and the color is
-/// correctly parsed;
-/// 400 HTTP status code is the color has not been recognised in the payload;
+/// <returns>The HTTP status code returned by the handler of the method;
+/// 400 HTTP status code if the payload does not match the fields of the method;
 /// 404 HTTP status code if the method name is unknown.</returns>
 static int DirectMethodCall(const char *methodName, const char *payload, size_t payloadSize,
                             char **responsePayload, size_t *responsePayloadSize)
 {
-    // Prepare the payload for the response. This is a heap allocated null terminated string.
-    // The Azure IoT Hub SDK is responsible of freeing it.
-    *responsePayload = NULL;  // Reponse payload content.
-    *responsePayloadSize = 0; // Response payload content size.
-
-    int result = 404; // HTTP status code.
-
-    if (strcmp(methodName, "LedColorControlMethod") != 0) {
-        result = 404;
-        Log_Debug("INFO: Method not found called: '%s'.\n", methodName);
-
-        static const char noMethodFound[] = "\"method not found '%s'\"";
-        size_t responseMaxLength = sizeof(noMethodFound) + strlen(methodName);
-        *responsePayload = SetupHeapMessage(noMethodFound, responseMaxLength, methodName);
-        if (*responsePayload == NULL) {
-            Log_Debug("ERROR: Could not allocate buffer for direct method response payload.\n");
-            abort();
-        }
-        *responsePayloadSize = strlen(*responsePayload);
-        return result;
-    }
-
-    RgbLedUtility_Colors ledColor = RgbLedUtility_Colors_Unknown;
-    // The payload should contains JSON such as: { "color": "red"}
-    char *directMethodCallContent = malloc(payloadSize + 1); // +1 to store null char at the end.
-    if (directMethodCallContent == NULL) {
-        Log_Debug("ERROR: Could not allocate buffer for direct method request payload.\n");
-        abort();
-    }
+    // Run DoWork again right away to send the response.
+    DoWorkScheduler_RequestNow();
+    return DirectMethod_Dispatch(methodName, payload, payloadSize, responsePayload,
+                                 responsePayloadSize);
+}
 
-    memcpy(directMethodCallContent, payload, payloadSize);
-    directMethodCallContent[payloadSize] = 0; // Null terminated string.
-    JSON_Value *payloadJson = json_parse_string(directMethodCallContent);
-    if (payloadJson == NULL) {
-        goto colorNotFound;
-    }
-    JSON_Object *colorJson = json_value_get_object(payloadJson);
-    if (colorJson == NULL) {
-        goto colorNotFound;
-    }
-    const char *colorName = json_object_get_string(colorJson, "color");
-    if (colorName == NULL) {
-        goto colorNotFound;
+/// <summary>
+///     Completes the messages of a batch whose outcome is known.
+/// </summary>
+/// <param name="confirmation">The batch and its outcome.</param>
+static void HandleBatchOutcome(const OutboundQueue_Confirmation *confirmation)
+{
+    // A batch of logged messages carries the sequence number of the last of them.
+    bool isLogBatch =
+        confirmation->lane == OutboundQueue_Lane_Telemetry && confirmation->context != 0;
+
+    switch (confirmation->outcome) {
+    case OutboundQueue_Outcome_Delivered:
+        LedAnimation_Play(led1Index, &solidGreen);
+        if (isLogBatch) {
+            MessageLog_Commit(confirmation->context);
+        }
+        break;
+    case OutboundQueue_Outcome_Retrying:
+        Log_Debug("WARNING: Batch %u was not delivered to the IoT Hub; sending it again.\n",
+                  confirmation->batchId);
+        // Its messages are not completed yet.
+        return;
+    case OutboundQueue_Outcome_Failed:
+        Log_Debug("ERROR: Batch %u was not delivered to the IoT Hub after %u attempts.\n",
+                  confirmation->batchId, confirmation->attempts);
+        LedAnimation_Play(led1Index, &solidRed);
+        // Logged messages stay in the log, and are sent again.
+        if (isLogBatch) {
+            MessageLog_Rewind();
+        }
+        break;
     }
 
-    ledColor = RgbLedUtility_GetColorFromString(colorName, strlen(colorName));
-
-    // If color's name has not been identified.
-    if (ledColor == RgbLedUtility_Colors_Unknown) {
-        goto colorNotFound;
+    bool delivered = confirmation->outcome == OutboundQueue_Outcome_Delivered;
+    for (size_t i = 0; i < confirmation->traceCount; i++) {
+        const LatencyTrace *trace = &confirmation->traces[i];
+        LatencyTrace_Complete(trace, delivered);
+        if (delivered) {
+            struct timespec now = LatencyTrace_Now();
+            Log_Debug("INFO: Message %u delivered %llu us after the press.\n", trace->id,
+                      (unsigned long long)LatencyTrace_ElapsedMicroseconds(&trace->edge, &now));
+        }
     }
+}
 
-    // Color's name has been identified.
-    result = 200;
-    const char *colorString = RgbLedUtility_GetStringFromColor(ledColor);
-    Log_Debug("INFO: LED color set to: '%s'.\n", colorString);
-    // Set the blinking LED color.
-    ledBlinkColor = ledColor;
+/// <summary>
+///     Message confirmation callback function, called when the IoT Hub SDK reports the outcome
+///     of a message sent with AzureIoT_SendMessage.
+/// </summary>
+/// <param name="delivered">'true' when the IoT Hub confirmed delivery of the message.</param>
+static void MessageDelivered(bool delivered)
+{
+    DoWorkScheduler_NotifyActivity();
 
-    static const char colorOkResponse[] =
-        "{ \"success\" : true, \"message\" : \"led color set to %s\" }";
-    size_t responseMaxLength = sizeof(colorOkResponse) + strlen(payload);
-    *responsePayload = SetupHeapMessage(colorOkResponse, responseMaxLength, colorString);
-    if (*responsePayload == NULL) {
-        Log_Debug("ERROR: Could not allocate buffer for direct method response payload.\n");
-        abort();
+    // Each confirmation is for a whole batch.
+    OutboundQueue_Confirmation confirmation;
+    int result = OutboundQueue_Confirm(delivered, &confirmation);
+    if (result < 0) {
+        Log_Debug("WARNING: Received a confirmation for no batch.\n");
     }
-    *responsePayloadSize = strlen(*responsePayload);
-
-    return result;
-
-colorNotFound:
-    result = 400; // Bad request.
-    Log_Debug("INFO: Unrecognised direct method payload format.\n");
-
-    static const char noColorResponse[] =
-        "{ \"success\" : false, \"message\" : \"request does not contain an identifiable "
-        "color\" }";
-    responseMaxLength = sizeof(noColorResponse);
-    *responsePayload = SetupHeapMessage(noColorResponse, responseMaxLength);
-    if (*responsePayload == NULL) {
-        Log_Debug("ERROR: Could not allocate buffer for direct method response payload.\n");
-        abort();
+    if (result != 0) {
+        return;
     }
-    *responsePayloadSize = strlen(*responsePayload);
-
-    return result;
-}
-
-void MessageDelivered(bool delivered)
-{
-	RgbLedUtility_SetLed(&led1, RgbLedUtility_Colors_Green);
+    HandleBatchOutcome(&confirmation);
 }
 
 /// <summary>
@@ -374,143 +537,158 @@ void MessageDelivered(bool delivered)
 static void IoTHubConnectionStatusChanged(bool connected)
 {
     connectedToIoTHub = connected;
+
+    // Report the properties that changed while disconnected, and start sending the messages
+    // logged meanwhile.
+    if (connected) {
+        ReportedProperties_Flush();
+        DoWorkScheduler_RequestNow();
+    } else {
+        // The confirmations of the batches in flight may never arrive; send them again once
+        // connected.
+        OutboundQueue_RequeueInFlight();
+    }
+
+    // Set network status with LED3 color.
+    LedAnimation_Play(led3Index, connected ? &solidGreen : &solidOff);
 }
 
 /// <summary>
-///     Handle the blinking for LED1.
+///     Handle button timer event: sample the buttons and queue any press that was detected.
 /// </summary>
-static void Led1UpdateHandler(event_data_t *eventData)
+static void ButtonsHandler(event_data_t *eventData)
 {
-    if (ConsumeTimerFdEvent(gpioLed1TimerFd) != 0) {
+    if (ConsumeTimerFdEvent(gpioButtonsManagementTimerFd) != 0) {
         terminationRequired = true;
         return;
     }
 
-    // Set network status with LED3 color.
-    RgbLedUtility_Colors color =
-        (connectedToIoTHub ? RgbLedUtility_Colors_Green : RgbLedUtility_Colors_Off);
-    RgbLedUtility_SetLed(&led3, color);
-
-    // Trigger LED to blink as appropriate.
-    blinkingLedState = !blinkingLedState;
-    color = (blinkingLedState ? ledBlinkColor : RgbLedUtility_Colors_Off);
-    //RgbLedUtility_SetLed(&led1, color);
+    if (InputScanner_Poll() != 0) {
+        terminationRequired = true;
+    }
 }
 
 /// <summary>
-///     Handle the blinking for LED2.
+///     Sends the open press burst as one message.
 /// </summary>
-static void Led2UpdateHandler(event_data_t *eventData)
+static void SendPressBurst(void)
 {
-    if (ConsumeTimerFdEvent(gpioLed2TimerFd) != 0) {
-        terminationRequired = true;
+    static char messagePayload[384];
+    struct timespec now = LatencyTrace_Now();
+    if (!PressAggregator_Emit(&pressAggregator, pressBurstTrace.id, &now, messagePayload,
+                              sizeof(messagePayload))) {
+        Log_Debug("ERROR: Aggregated press message does not fit in its buffer.\n");
         return;
     }
 
-    // Clear the send/receive LED2.
-    RgbLedUtility_SetLed(&led2, RgbLedUtility_Colors_Off);
+    SendMessageToIotHub(messagePayload, strlen(messagePayload), &pressBurstTrace);
 }
 
 /// <summary>
-///     Check whether a given button has just been pressed.
+///     Sends the press burst just opened if it is due, or arms the timer that sends it when it
+///     is.
 /// </summary>
-/// <param name="fd">The button file descriptor</param>
-/// <param name="oldState">Old state of the button (pressed or released)</param>
-/// <returns>true if pressed, false otherwise</returns>
-static bool IsButtonPressed(int fd, GPIO_Value_Type *oldState)
+/// <returns>0 on success, or -1 if the timer could not be armed.</returns>
+static int SendOrSchedulePressBurst(void)
 {
-    bool isButtonPressed = false;
-    GPIO_Value_Type newState;
-    int result = GPIO_GetValue(fd, &newState);
-    if (result != 0) {
-        Log_Debug("ERROR: Could not read button GPIO: %s (%d).\n", strerror(errno), errno);
-        terminationRequired = true;
-    } else {
-        // Button is pressed if it is low and different than last known state.
-        isButtonPressed = (newState != *oldState) && (newState == GPIO_Value_Low);
-        *oldState = newState;
+    struct timespec now = LatencyTrace_Now();
+    if (PressAggregator_IsDue(&pressAggregator, &now)) {
+        SendPressBurst();
+        return 0;
     }
 
-    return isButtonPressed;
-}
-
-GPIO_Value_Type easyButtonState;
-int easyButtonCount;
-bool easyButtonArmed = false;
-
-static bool IsEasyButtonPressed()
-{
-	GPIO_Value_Type newState;
-	int result = GPIO_GetValue(gpioEasyButtonFd, &newState);
-	if (result != 0) {
-		Log_Debug("ERROR: Could not read button GPIO for easy button: %s (%d).\n", strerror(errno), errno);
-		terminationRequired = true;
-	}
-	else if(easyButtonState != newState && easyButtonCount > 450) {
-		easyButtonCount = 0;
-		easyButtonState = newState;
-		if (easyButtonState == GPIO_Value_High)
-		{
-			return true;
-		}
-		return false;
-	}
-
-	easyButtonCount++;
-	easyButtonState = newState;
-	return false;
+    struct timespec emitDelay = PressAggregator_GetEmitDelay(&pressAggregator, &now);
+    return SetTimerFdToSingleExpiry(pressAggregationTimerFd, &emitDelay);
 }
 
 /// <summary>
-///     Handle button timer event: if the button is pressed, change the LED blink rate.
+///     Handle queued button presses: button A arms the easy button, and button B or the easy
+///     button sends a message to the IoT Hub when armed.
 /// </summary>
-static void ButtonsHandler(event_data_t *eventData)
+static void ButtonEventsHandler(event_data_t *eventData)
 {
-    if (ConsumeTimerFdEvent(gpioButtonsManagementTimerFd) != 0) {
+    if (ConsumeEventFdEvent(buttonEventsFd) != 0) {
         terminationRequired = true;
         return;
     }
 
-    // If the button is pressed, change the LED blink interval, and update the Twin Device.
-    static GPIO_Value_Type blinkButtonState;
-    if (IsButtonPressed(gpioLedBlinkRateButtonFd, &blinkButtonState)) {
-		easyButtonArmed = true;
-		RgbLedUtility_SetLed(&led1, RgbLedUtility_Colors_Blue);
-        //blinkIntervalIndex = (blinkIntervalIndex + 1) % blinkIntervalsCount;
-        //SetLedRate(&blinkIntervals[blinkIntervalIndex]);
+    if (InputScanner_HasFailed()) {
+        terminationRequired = true;
+        return;
     }
 
-    // If the button is pressed, send a message to the IoT Hub.
-    static GPIO_Value_Type messageButtonState;
-    if (IsButtonPressed(gpioSendMessageButtonFd, &messageButtonState)) {
-		Log_Debug("Message button pressed (state %d)\n	", messageButtonState);
-		if (easyButtonArmed)
-		{
-			easyButtonArmed = false;
-			RgbLedUtility_SetLed(&led1, RgbLedUtility_Colors_Red);
-			SendMessageToIotHub("That was easy");
-		}
+    uint32_t overruns = ButtonEventQueue_TakeOverruns(&buttonEvents);
+    if (overruns != 0) {
+        Log_Debug("WARNING: %u button presses dropped; event queue full.\n", overruns);
+    }
+
+    ButtonEvent event;
+    while (ButtonEventQueue_Pop(&buttonEvents, &event)) {
+        struct timespec now = LatencyTrace_Now();
+        LatencyTrace_Record(LatencyTrace_Stage_EdgeToDispatch, &event.timestamp, &now);
+
+        switch (event.input) {
+        case ButtonEvent_Input_ButtonA:
+            easyButtonArmed = true;
+            LedAnimation_Play(led1Index, &solidBlue);
+            break;
+
+        case ButtonEvent_Input_ButtonB:
+        case ButtonEvent_Input_EasyButton:
+            Log_Debug("INFO: %s pressed at %lld.%09ld.\n",
+                      event.input == ButtonEvent_Input_ButtonB ? "Message button" : "Easy button",
+                      (long long)event.timestamp.tv_sec, event.timestamp.tv_nsec);
+            if (PressAggregator_Accepts(&pressAggregator, &event.timestamp)) {
+                // Part of a burst that is already waiting to be sent, which keeps its trace, or
+                // the first press to follow one that was sent right away, which opens a burst
+                // sent at the end of the window.
+                if (PressAggregator_Add(&pressAggregator, &event.timestamp)) {
+                    LatencyTrace_Begin(&pressBurstTrace, &event.timestamp);
+                    if (SendOrSchedulePressBurst() != 0) {
+                        terminationRequired = true;
+                        return;
+                    }
+                }
+            } else if (easyButtonArmed) {
+                easyButtonArmed = false;
+                LedAnimation_Play(led1Index, &solidRed);
+
+                // The press that opens a window is sent right away, unless the rate limit holds
+                // it back.
+                LatencyTrace_Begin(&pressBurstTrace, &event.timestamp);
+                PressAggregator_Add(&pressAggregator, &event.timestamp);
+                if (SendOrSchedulePressBurst() != 0) {
+                    terminationRequired = true;
+                    return;
+                }
+            }
+            break;
+        }
     }
+}
 
-	static GPIO_Value_Type easyButtonState;
-
-	int easyResult = GPIO_GetValue(gpioEasyButtonFd, &easyButtonState);
+/// <summary>
+///     Handle the end of a press burst: send the aggregated presses as one message.
+/// </summary>
+static void PressAggregationHandler(event_data_t *eventData)
+{
+    if (ConsumeTimerFdEvent(pressAggregationTimerFd) != 0) {
+        terminationRequired = true;
+        return;
+    }
 
-	//Log_Debug("Easy state is %d\n", easyButtonState);
+    // The burst may have been sent, or its timer re-armed, by the handling of a press earlier
+    // in the same dispatch batch.
+    struct timespec now = LatencyTrace_Now();
+    if (pressAggregator.count == 0 || !PressAggregator_IsDue(&pressAggregator, &now)) {
+        return;
+    }
 
-	if (IsEasyButtonPressed()) {
-		Log_Debug("Easy button pressed (state %d)\n	", easyButtonState);
-		if (easyButtonArmed)
-		{
-			easyButtonArmed = false;
-			RgbLedUtility_SetLed(&led1, RgbLedUtility_Colors_Red);
-			SendMessageToIotHub("That was easy");
-		}
-	}
+    SendPressBurst();
 }
 
 /// <summary>
-///     Hand over control periodically to the Azure IoT SDK's DoWork.
+///     Hand over control to the Azure IoT SDK's DoWork, and schedule its next run.
 /// </summary>
 static void AzureIotDoWorkHandler(event_data_t *eventData)
 {
@@ -518,21 +696,58 @@ static void AzureIotDoWorkHandler(event_data_t *eventData)
         terminationRequired = true;
         return;
     }
+    DoWorkScheduler_BeginRun();
 
     // Set up the connection to the IoT Hub client.
     // Notes it is safe to call this function even if the client has already been set up, as in
     //   this case it would have no effect
     if (AzureIoT_SetupClient()) {
+        // Send the queued messages once the oldest of them has waited long enough, so that they
+        // go out with this DoWork, highest priority lane first.
+        struct timespec now = LatencyTrace_Now();
+        OutboundQueue_FlushDue(&now);
+
+        // Send the messages logged while offline as telemetry, one batch at a time, while the
+        // telemetry lane may send. A full batch is sent as its last message is queued.
+        const OutboundQueue_LaneConfig *telemetryConfig =
+            &outboundQueueConfig.lanes[OutboundQueue_Lane_Telemetry];
+        if (connectedToIoTHub && MessageLog_GetPendingCount() != 0 &&
+            OutboundQueue_GetQueuedCount(OutboundQueue_Lane_Telemetry) == 0 &&
+            OutboundQueue_CanSend(OutboundQueue_Lane_Telemetry) &&
+            MessageLog_Replay(telemetryConfig->maxMessageCount, &QueueLoggedMessage) > 0) {
+            OutboundQueue_Flush(OutboundQueue_Lane_Telemetry);
+        }
+
         // AzureIoT_DoPeriodicTasks() needs to be called frequently in order to keep active
         // the flow of data with the Azure IoT Hub
         AzureIoT_DoPeriodicTasks();
+
+        // Give up waiting for the confirmations the SDK never reports, so that their batches
+        // do not hold their place in the window.
+        OutboundQueue_Confirmation confirmation;
+        now = LatencyTrace_Now();
+        while (OutboundQueue_ExpireConfirmation(&now, &confirmation) == 0) {
+            Log_Debug("WARNING: Batch %u was not confirmed in time.\n", confirmation.batchId);
+            HandleBatchOutcome(&confirmation);
+        }
+    }
+
+    // Run again soon while batches await their confirmation or logged messages remain to be
+    // sent, and no later than the deadline of the queued messages.
+    bool awaitingConfirmations =
+        connectedToIoTHub &&
+        (OutboundQueue_GetInFlightCount() != 0 || MessageLog_GetPendingCount() != 0);
+    DoWorkScheduler_ScheduleNext(awaitingConfirmations);
+    struct timespec flushDeadline;
+    if (connectedToIoTHub && OutboundQueue_GetFlushDeadline(&flushDeadline)) {
+        DoWorkScheduler_RequestBy(&flushDeadline);
     }
 }
 
 // event handler data structures. Only the event handler field needs to be populated.
 static event_data_t buttonsEventData = {.eventHandler = &ButtonsHandler};
-static event_data_t led1EventData = {.eventHandler = &Led1UpdateHandler};
-static event_data_t led2EventData = {.eventHandler = &Led2UpdateHandler};
+static event_data_t buttonEventsEventData = {.eventHandler = &ButtonEventsHandler};
+static event_data_t pressAggregationEventData = {.eventHandler = &PressAggregationHandler};
 static event_data_t azureIotEventData = {.eventHandler = &AzureIotDoWorkHandler};
 
 /// <summary>
@@ -547,26 +762,11 @@ static int InitPeripheralsAndHandlers(void)
     action.sa_handler = TerminationHandler;
     sigaction(SIGTERM, &action, NULL);
 
-    // Open button A
-    Log_Debug("INFO: Opening MT3620_RDB_BUTTON_A.\n");
-    if (!OpenGpioFdAsInput(MT3620_RDB_BUTTON_A, &gpioLedBlinkRateButtonFd)) {
-        return -1;
-    }
-
-    // Open button B
-    Log_Debug("INFO: Opening MT3620_RDB_BUTTON_B.\n");
-    if (!OpenGpioFdAsInput(MT3620_RDB_BUTTON_B, &gpioSendMessageButtonFd)) {
-        return -1;
-    }
-
-	Log_Debug("INFO: Opening MT3620_RDB_HEADER1_PIN4_GPIO for Easy Button.\n");
-	if (!OpenGpioFdAsInput(MT3620_RDB_HEADER1_PIN4_GPIO, &gpioEasyButtonFd)) {
-		return -1;
-	}
-
     // Open file descriptors for the RGB LEDs and store them in the rgbLeds array (and in turn in
     // the ledBlink, ledMessageEventSentReceived, ledNetworkStatus variables)
-    RgbLedUtility_OpenLeds(rgbLeds, rgbLedsCount, ledsPins);
+    if (RgbLedUtility_OpenLeds(rgbLeds, rgbLedsCount, ledsPins) != 0) {
+        return -1;
+    }
 
     // Initialize the Azure IoT SDK
     if (!AzureIoT_Initialize()) {
@@ -576,6 +776,11 @@ static int InitPeripheralsAndHandlers(void)
 
 	RgbLedUtility_SetLed(&led1, RgbLedUtility_Colors_Off);
 
+    if (DirectMethod_Init(directMethods, directMethodsCount) != 0 ||
+        DesiredProperties_Init(desiredPropertyTable, desiredPropertyCount) != 0) {
+        return -1;
+    }
+
     // Set the Azure IoT hub related callbacks
     AzureIoT_SetMessageReceivedCallback(&MessageReceived);
 	AzureIoT_SetMessageConfirmationCallback(&MessageDelivered);
@@ -583,6 +788,14 @@ static int InitPeripheralsAndHandlers(void)
     AzureIoT_SetDirectMethodCallback(&DirectMethodCall);
     AzureIoT_SetConnectionStatusCallback(&IoTHubConnectionStatusChanged);
 
+    if (OutboundQueue_Init(&outboundQueueConfig, &SendBatchToIotHub) != 0) {
+        return -1;
+    }
+
+    if (MessageLog_Open() != 0) {
+        return -1;
+    }
+
     // Display the currently connected WiFi connection.
     DebugPrintCurrentlyConnectedWiFiNetwork();
 
@@ -591,34 +804,65 @@ static int InitPeripheralsAndHandlers(void)
         return -1;
     }
 
-    // Set up a timer for LED1 blinking
-    gpioLed1TimerFd =
-        CreateTimerFdAndAddToEpoll(epollFd, &blinkingLedPeriod, &led1EventData, EPOLLIN);
-    if (gpioLed1TimerFd < 0) {
+    // Set up the PWM engine, which drives LEDs whose color is not one of the eight
+    // RgbLedUtility_Colors.
+    if (RgbLedPwm_Init(epollFd, rgbLeds, rgbLedsCount) != 0) {
         return -1;
     }
 
-    // Set up a timer for blinking LED2 once.
-    gpioLed2TimerFd = CreateTimerFdAndAddToEpoll(epollFd, &nullPeriod, &led2EventData, EPOLLIN);
-    if (gpioLed2TimerFd < 0) {
+    // Set up the animation engine, which drives every LED status pattern from one frame clock.
+    if (LedAnimation_Init(epollFd, rgbLeds, rgbLedsCount) != 0) {
         return -1;
     }
 
-    // Set up a timer for buttons status check
-    static struct timespec buttonsPressCheckPeriod = {0, 1000000};
-    gpioButtonsManagementTimerFd =
-        CreateTimerFdAndAddToEpoll(epollFd, &buttonsPressCheckPeriod, &buttonsEventData, EPOLLIN);
-    if (gpioButtonsManagementTimerFd < 0) {
+    if (ReportedProperties_Init(epollFd, &reportedPropertiesFlushDelay, &ReportPropertyToIotHub) !=
+        0) {
+        return -1;
+    }
+
+    // Set up the queue and event used to hand button presses over from the input scanner, and
+    // open the buttons.
+    ButtonEventQueue_Init(&buttonEvents);
+    buttonEventsFd = CreateEventFdAndAddToEpoll(epollFd, &buttonEventsEventData, EPOLLIN);
+    if (buttonEventsFd < 0) {
+        return -1;
+    }
+    if (InputScanner_Open(buttonInputs, buttonInputsCount, &buttonEvents, buttonEventsFd) != 0) {
         return -1;
     }
 
-    // Set up a timer for Azure IoT SDK DoWork execution.
-    static struct timespec azureIotDoWorkPeriod = {1, 0};
+    // Set up a timer for emitting aggregated press bursts.
+    PressAggregator_Init(&pressAggregator, &pressAggregatorConfig);
+    pressAggregationTimerFd =
+        CreateTimerFdAndAddToEpoll(epollFd, &nullPeriod, &pressAggregationEventData, EPOLLIN);
+    if (pressAggregationTimerFd < 0) {
+        return -1;
+    }
+
+    if (busyPollInput) {
+        Log_Debug("INFO: Busy-polling the buttons from a dedicated thread.\n");
+        if (InputScanner_StartBusyPoll() != 0) {
+            return -1;
+        }
+    } else {
+        // Set up a timer for buttons status check
+        static struct timespec buttonsPressCheckPeriod = {0, 1000000};
+        gpioButtonsManagementTimerFd = CreateTimerFdAndAddToEpoll(
+            epollFd, &buttonsPressCheckPeriod, &buttonsEventData, EPOLLIN);
+        if (gpioButtonsManagementTimerFd < 0) {
+            return -1;
+        }
+    }
+
+    // Set up a timer for Azure IoT SDK DoWork execution, scheduled on demand.
     azureIotDoWorkTimerFd =
-        CreateTimerFdAndAddToEpoll(epollFd, &azureIotDoWorkPeriod, &azureIotEventData, EPOLLIN);
+        CreateTimerFdAndAddToEpoll(epollFd, &nullPeriod, &azureIotEventData, EPOLLIN);
     if (azureIotDoWorkTimerFd < 0) {
         return -1;
     }
+    if (DoWorkScheduler_Init(azureIotDoWorkTimerFd, &doWorkSchedulerConfig) != 0) {
+        return -1;
+    }
 
     return 0;
 }
@@ -630,21 +874,34 @@ static void ClosePeripheralsAndHandlers(void)
 {
     Log_Debug("INFO: Closing GPIOs and Azure IoT client.\n");
 
+    // Stop scanning the buttons
+    InputScanner_Close();
+
+    // Destroy the IoT Hub client first: it reports the outstanding messages and the loss of
+    // the connection, and the callbacks use the queues, the log and the LEDs.
+    AzureIoT_DestroyClient();
+
     // Close all file descriptors
-    CloseFdAndPrintError(gpioLedBlinkRateButtonFd, "LedBlinkRateButton");
-    CloseFdAndPrintError(gpioSendMessageButtonFd, "SendMessageButton");
-	CloseFdAndPrintError(gpioEasyButtonFd, "EasyButton");
     CloseFdAndPrintError(gpioButtonsManagementTimerFd, "ButtonsManagementTimer");
+    CloseFdAndPrintError(buttonEventsFd, "ButtonEvents");
+    CloseFdAndPrintError(pressAggregationTimerFd, "PressAggregationTimer");
     CloseFdAndPrintError(azureIotDoWorkTimerFd, "IotDoWorkTimer");
-    CloseFdAndPrintError(gpioLed1TimerFd, "Led1Timer");
-    CloseFdAndPrintError(gpioLed2TimerFd, "Led2Timer");
     CloseFdAndPrintError(epollFd, "Epoll");
 
+    LatencyTrace_LogSummary();
+    OutboundQueue_LogSummary();
+    LatencyHistogram_LogSummary("button sample interval",
+                                InputScanner_GetSampleIntervalHistogram());
+
+    MessageLog_Close();
+    ReportedProperties_Close();
+    DesiredProperties_Close();
+
     // Close the LEDs and leave then off
+    LedAnimation_Close();
+    RgbLedPwm_Close();
     RgbLedUtility_CloseLeds(rgbLeds, rgbLedsCount);
 
-    // Destroy the IoT Hub client
-    AzureIoT_DestroyClient();
     AzureIoT_Deinitialize();
 }
 
@@ -655,6 +912,12 @@ int main(int argc, char *argv[])
 {
     Log_Debug("INFO: Azure IoT application starting.\n");
 
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--busy-poll") == 0) {
+            busyPollInput = true;
+        }
+    }
+
     int initResult = InitPeripheralsAndHandlers();
     if (initResult != 0) {
         terminationRequired = true;
@@ -664,6 +927,9 @@ int main(int argc, char *argv[])
         if (WaitForEventAndCallHandler(epollFd) != 0) {
             terminationRequired = true;
         }
+
+        // Write the final LED colors requested by the handlers that just ran.
+        RgbLedUtility_RenderLeds();
     }
 
     ClosePeripheralsAndHandlers();
@@ -0,0 +1,263 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <applibs/log.h>
+
+#ifdef EASYBUTTON_HOST_BUILD
+#include <fcntl.h>
+#else
+#include <applibs/storage.h>
+#endif
+
+#include "message_log.h"
+
+/// <summary>
+///     Types of the records of the log.
+/// </summary>
+typedef enum {
+    MessageLog_RecordType_Message = 1,
+    /// <summary>All messages up to the sequence number in the payload have been replayed.</summary>
+    MessageLog_RecordType_Checkpoint = 2
+} MessageLog_RecordType;
+
+/// <summary>
+///     On-storage layout of a record slot. Sequence number 0 marks a slot never written.
+/// </summary>
+typedef struct MessageLog_Record {
+    uint32_t sequence;
+    uint16_t type;
+    uint16_t length;
+    /// <summary>CRC-32 of the record with this field set to 0.</summary>
+    uint32_t crc;
+    /// <summary>The message, with room for a terminating null character.</summary>
+    char payload[MESSAGE_LOG_MAX_PAYLOAD + 1];
+} MessageLog_Record;
+
+_Static_assert(sizeof(MessageLog_Record) == MESSAGE_LOG_SLOT_SIZE,
+               "A record must fill exactly one slot.");
+
+static int logFd = -1;
+// Sequence number of the next record appended.
+static uint32_t nextSequence = 1;
+// Sequence number of the next message to replay.
+static uint32_t replaySequence = 1;
+// Sequence number of the oldest record not committed; MessageLog_Rewind replays from it.
+static uint32_t commitSequence = 1;
+static uint32_t crcTable[256];
+
+static void InitCrcTable(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+        crcTable[i] = crc;
+    }
+}
+
+static uint32_t ComputeCrc(const MessageLog_Record *record)
+{
+    MessageLog_Record copy = *record;
+    copy.crc = 0;
+
+    const uint8_t *bytes = (const uint8_t *)&copy;
+    // Only the used part of the payload is covered, so stale bytes after it do not matter.
+    size_t size = offsetof(MessageLog_Record, payload) + record->length;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = crcTable[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static off_t SlotOffset(uint32_t sequence)
+{
+    return (off_t)(sequence % MESSAGE_LOG_SLOT_COUNT) * MESSAGE_LOG_SLOT_SIZE;
+}
+
+/// <summary>
+///     Reads the record of the given sequence number.
+/// </summary>
+/// <returns>true if the slot holds a valid record with that sequence number.</returns>
+static bool ReadRecord(uint32_t sequence, MessageLog_Record *record)
+{
+    ssize_t bytesRead = pread(logFd, record, sizeof(*record), SlotOffset(sequence));
+    return bytesRead == (ssize_t)sizeof(*record) && record->sequence == sequence &&
+           record->length <= MESSAGE_LOG_MAX_PAYLOAD && record->crc == ComputeCrc(record);
+}
+
+/// <summary>
+///     Writes a record with the next sequence number into its slot, as one whole block.
+/// </summary>
+static int WriteRecord(MessageLog_RecordType type, const void *payload, size_t length)
+{
+    MessageLog_Record record;
+    memset(&record, 0, sizeof(record));
+    record.sequence = nextSequence;
+    record.type = (uint16_t)type;
+    record.length = (uint16_t)length;
+    memcpy(record.payload, payload, length);
+    record.crc = ComputeCrc(&record);
+
+    ssize_t written = pwrite(logFd, &record, sizeof(record), SlotOffset(record.sequence));
+    if (written != (ssize_t)sizeof(record)) {
+        Log_Debug("ERROR: Could not write message log record: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    nextSequence++;
+    return 0;
+}
+
+int MessageLog_Open(void)
+{
+    InitCrcTable();
+
+#ifdef EASYBUTTON_HOST_BUILD
+    logFd = open(MESSAGE_LOG_HOST_PATH, O_RDWR | O_CREAT, 0644);
+#else
+    logFd = Storage_OpenMutableFile();
+#endif
+    if (logFd < 0) {
+        Log_Debug("ERROR: Could not open the message log: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    // Recover the newest record and the newest checkpoint from the slots.
+    uint32_t newestSequence = 0;
+    uint32_t checkpointSequence = 0;
+    for (uint32_t slot = 0; slot < MESSAGE_LOG_SLOT_COUNT; slot++) {
+        MessageLog_Record record;
+        ssize_t bytesRead =
+            pread(logFd, &record, sizeof(record), (off_t)slot * MESSAGE_LOG_SLOT_SIZE);
+        if (bytesRead != (ssize_t)sizeof(record) || record.sequence == 0 ||
+            record.sequence % MESSAGE_LOG_SLOT_COUNT != slot ||
+            record.length > MESSAGE_LOG_MAX_PAYLOAD || record.crc != ComputeCrc(&record)) {
+            continue;
+        }
+
+        if (record.sequence > newestSequence) {
+            newestSequence = record.sequence;
+        }
+        if (record.type == MessageLog_RecordType_Checkpoint &&
+            record.length == sizeof(uint32_t)) {
+            uint32_t replayed;
+            memcpy(&replayed, record.payload, sizeof(replayed));
+            if (replayed > checkpointSequence) {
+                checkpointSequence = replayed;
+            }
+        }
+    }
+
+    nextSequence = newestSequence + 1;
+    replaySequence = checkpointSequence + 1;
+    // Older records have been overwritten.
+    if (nextSequence > MESSAGE_LOG_SLOT_COUNT &&
+        replaySequence < nextSequence - MESSAGE_LOG_SLOT_COUNT) {
+        replaySequence = nextSequence - MESSAGE_LOG_SLOT_COUNT;
+    }
+    commitSequence = replaySequence;
+
+    Log_Debug("INFO: Message log opened with %u records to replay.\n",
+              nextSequence - replaySequence);
+    return 0;
+}
+
+int MessageLog_Append(const char *payload, size_t length)
+{
+    if (length > MESSAGE_LOG_MAX_PAYLOAD) {
+        Log_Debug("ERROR: Message of %zu bytes is too long for the message log.\n", length);
+        return -1;
+    }
+
+    if (nextSequence - commitSequence >= MESSAGE_LOG_SLOT_COUNT) {
+        Log_Debug("WARNING: Message log full; overwriting record %u.\n", commitSequence);
+        commitSequence++;
+        if (replaySequence < commitSequence) {
+            replaySequence = commitSequence;
+        }
+    }
+
+    return WriteRecord(MessageLog_RecordType_Message, payload, length);
+}
+
+size_t MessageLog_GetPendingCount(void)
+{
+    // Includes checkpoint records, which the replay skips.
+    return nextSequence - replaySequence;
+}
+
+int MessageLog_Replay(size_t maxCount, MessageLog_ReplayHandler handler)
+{
+    if (replaySequence != commitSequence) {
+        return 0;
+    }
+
+    size_t replayed = 0;
+    while (replaySequence != nextSequence && replayed < maxCount) {
+        MessageLog_Record record;
+        bool isRecord = ReadRecord(replaySequence, &record);
+        if (!isRecord || record.type != MessageLog_RecordType_Message) {
+            // Leave the records that are not replayed after the last message to the next
+            // replay, so that committing that message brings the commit up to the replay.
+            if (replayed != 0) {
+                break;
+            }
+            if (!isRecord) {
+                Log_Debug("WARNING: Skipping corrupted message log record %u.\n",
+                          replaySequence);
+            }
+            replaySequence++;
+            continue;
+        }
+
+        record.payload[record.length] = '\0';
+        if (!handler(record.payload, record.length, replaySequence)) {
+            break;
+        }
+        replayed++;
+        replaySequence++;
+    }
+
+    // Records skipped without replaying a message need no commit.
+    if (replayed == 0) {
+        commitSequence = replaySequence;
+    }
+    return (int)replayed;
+}
+
+int MessageLog_Commit(uint32_t lastSequence)
+{
+    // Records overwritten or committed meanwhile are not committed again.
+    if ((int32_t)(lastSequence - commitSequence) < 0) {
+        return 0;
+    }
+
+    // Once the replay has caught up, the checkpoint covers itself too.
+    bool caughtUp = lastSequence + 1 == nextSequence;
+    uint32_t committed = caughtUp ? nextSequence : lastSequence;
+    if (WriteRecord(MessageLog_RecordType_Checkpoint, &committed, sizeof(committed)) != 0) {
+        return -1;
+    }
+
+    commitSequence = committed + 1;
+    if (replaySequence < commitSequence) {
+        replaySequence = commitSequence;
+    }
+    return 0;
+}
+
+void MessageLog_Rewind(void)
+{
+    replaySequence = commitSequence;
+}
+
+void MessageLog_Close(void)
+{
+    if (logFd >= 0) {
+        close(logFd);
+        logFd = -1;
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+///     Size of a record slot of the message log, in bytes. Each record is written as one whole,
+///     slot-aligned block.
+/// </summary>
+#define MESSAGE_LOG_SLOT_SIZE 512
+
+/// <summary>
+///     Number of record slots of the message log. The log file is MESSAGE_LOG_SLOT_COUNT *
+///     MESSAGE_LOG_SLOT_SIZE bytes, which must fit in the MutableStorage of the app manifest.
+/// </summary>
+#define MESSAGE_LOG_SLOT_COUNT 32
+
+/// <summary>
+///     Maximum length of a logged message.
+/// </summary>
+#define MESSAGE_LOG_MAX_PAYLOAD (MESSAGE_LOG_SLOT_SIZE - 13)
+
+/// <summary>
+///     Path of the file backing the message log in the host build.
+/// </summary>
+#define MESSAGE_LOG_HOST_PATH "easybutton_message_log.bin"
+
+/// <summary>
+///     Function called for each logged message replayed by MessageLog_Replay.
+/// </summary>
+/// <param name="payload">The message, JSON text followed by a null character.</param>
+/// <param name="length">The length of the message.</param>
+/// <param name="sequence">The sequence number of the message, never 0, to pass to
+/// MessageLog_Commit once the message is delivered.</param>
+/// <returns>true if the message was taken, false to stop the replay before it.</returns>
+typedef bool (*MessageLog_ReplayHandler)(const char *payload, size_t length, uint32_t sequence);
+
+/// <summary>
+///     Opens the message log, an append-only ring of fixed-size records kept in the mutable
+///     storage of the app (a regular file in the host build), and recovers the messages that
+///     were logged and not confirmed delivered before the last restart.
+///     Every record carries a sequence number and a CRC-32, so that torn or stale records are
+///     ignored. Replay progress is appended as checkpoint records rather than written in place,
+///     so no block is ever rewritten partially.
+/// </summary>
+/// <returns>0 on success, or -1 on failure.</returns>
+int MessageLog_Open(void);
+
+/// <summary>
+///     Appends a message to the log. Once the ring is full, the oldest records are overwritten.
+/// </summary>
+/// <param name="payload">The message, JSON text.</param>
+/// <param name="length">The length of the message, at most MESSAGE_LOG_MAX_PAYLOAD.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int MessageLog_Append(const char *payload, size_t length);
+
+/// <summary>
+///     Returns the number of logged messages not replayed yet.
+/// </summary>
+size_t MessageLog_GetPendingCount(void);
+
+/// <summary>
+///     Replays up to 'maxCount' logged messages, oldest first. They stay in the log, and are
+///     replayed again after a restart, until MessageLog_Commit records their delivery. Nothing
+///     is replayed while earlier replayed messages await MessageLog_Commit or MessageLog_Rewind,
+///     so that the progress recorded never passes a message that was not delivered.
+/// </summary>
+/// <param name="maxCount">The maximum number of messages to replay.</param>
+/// <param name="handler">The function called for each message.</param>
+/// <returns>The number of messages replayed.</returns>
+int MessageLog_Replay(size_t maxCount, MessageLog_ReplayHandler handler);
+
+/// <summary>
+///     Records in the log that the messages replayed up to a sequence number were delivered,
+///     so that they are not replayed again, even after a restart.
+/// </summary>
+/// <param name="lastSequence">The sequence number of the last message of the replay, as
+/// passed to the replay handler.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int MessageLog_Commit(uint32_t lastSequence);
+
+/// <summary>
+///     Makes the replayed messages that were not committed due again, e.g. after they could
+///     not be delivered.
+/// </summary>
+void MessageLog_Rewind(void);
+
+/// <summary>
+///     Closes the message log.
+/// </summary>
+void MessageLog_Close(void);
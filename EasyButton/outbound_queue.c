@@ -0,0 +1,450 @@
+#include <string.h>
+
+#include <applibs/log.h>
+
+#include "outbound_queue.h"
+
+static OutboundQueue_Config queueConfig;
+static OutboundQueue_SendHandler queueSendHandler = NULL;
+
+// The batch being accumulated by a lane: "[message,message,...", closed when it is sent.
+typedef struct OutboundLane {
+    char batch[OUTBOUND_QUEUE_MAX_BATCH_SIZE];
+    size_t batchLength;
+    LatencyTrace traces[OUTBOUND_QUEUE_MAX_MESSAGES];
+    size_t messageCount;
+    size_t traceCount;
+    uint32_t context;
+    struct timespec oldestQueued;
+} OutboundLane;
+
+static OutboundLane lanes[OutboundQueue_Lane_Count];
+
+typedef enum {
+    InFlightState_Free = 0,
+    InFlightState_AwaitingConfirmation,
+    InFlightState_AwaitingRetry
+} InFlightState;
+
+// A batch of the in-flight window, closed and ready to be sent again.
+typedef struct InFlightBatch {
+    InFlightState state;
+    uint32_t id;
+    OutboundQueue_Lane lane;
+    uint32_t context;
+    unsigned int attempts;
+    struct timespec lastSent;
+    char batch[OUTBOUND_QUEUE_MAX_BATCH_SIZE];
+    size_t batchLength;
+    LatencyTrace traces[OUTBOUND_QUEUE_MAX_MESSAGES];
+    size_t traceCount;
+} InFlightBatch;
+
+static InFlightBatch window[OUTBOUND_QUEUE_MAX_IN_FLIGHT];
+static size_t windowCount = 0;
+static uint32_t nextBatchId = 1;
+
+// Window indices of the batches waiting for a confirmation, in send order.
+static uint8_t sendOrder[OUTBOUND_QUEUE_MAX_IN_FLIGHT];
+static size_t sendOrderHead = 0;
+static size_t sendOrderCount = 0;
+
+// Sends of batches that timed out or were requeued, whose confirmations the SDK still owes, in
+// send order; they all precede the sends of sendOrder. Each holds the time of its send.
+#define MAX_OWED_CONFIRMATIONS (2 * OUTBOUND_QUEUE_MAX_IN_FLIGHT)
+static struct timespec owedConfirmations[MAX_OWED_CONFIRMATIONS];
+static size_t owedHead = 0;
+static size_t owedCount = 0;
+
+static LatencyHistogram confirmationLatency;
+static uint32_t batchesSent = 0;
+static uint32_t batchesResent = 0;
+static uint32_t batchesFailed = 0;
+static uint32_t batchesExpired = 0;
+static uint32_t lateConfirmations = 0;
+static uint32_t unmatchedConfirmations = 0;
+
+static int64_t ToNanoseconds(const struct timespec *time)
+{
+    return (int64_t)time->tv_sec * 1000000000LL + time->tv_nsec;
+}
+
+/// <summary>
+///     Gets the time at which the oldest message of a lane reaches the age threshold.
+/// </summary>
+static struct timespec GetDeadline(OutboundQueue_Lane lane)
+{
+    const struct timespec *maxAge = &queueConfig.lanes[lane].maxAge;
+    struct timespec deadline = {.tv_sec = lanes[lane].oldestQueued.tv_sec + maxAge->tv_sec,
+                                .tv_nsec = lanes[lane].oldestQueued.tv_nsec + maxAge->tv_nsec};
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
+/// <summary>
+///     Hands a closed batch of the window to the send handler, and waits for its confirmation.
+/// </summary>
+/// <returns>0 on success, or -1 if the batch could not be sent.</returns>
+static int Transmit(size_t index)
+{
+    InFlightBatch *inFlight = &window[index];
+    if (!queueSendHandler(inFlight->batch)) {
+        return -1;
+    }
+
+    inFlight->state = InFlightState_AwaitingConfirmation;
+    inFlight->attempts++;
+    inFlight->lastSent = LatencyTrace_Now();
+    sendOrder[(sendOrderHead + sendOrderCount) % OUTBOUND_QUEUE_MAX_IN_FLIGHT] = (uint8_t)index;
+    sendOrderCount++;
+    return 0;
+}
+
+/// <summary>
+///     Sends again the batches of a lane that await a retry, oldest first.
+/// </summary>
+/// <returns>0 on success, or -1 if a batch could not be sent.</returns>
+static int Retransmit(OutboundQueue_Lane lane)
+{
+    for (;;) {
+        size_t oldest = OUTBOUND_QUEUE_MAX_IN_FLIGHT;
+        for (size_t i = 0; i < OUTBOUND_QUEUE_MAX_IN_FLIGHT; i++) {
+            if (window[i].state == InFlightState_AwaitingRetry && window[i].lane == lane &&
+                (oldest == OUTBOUND_QUEUE_MAX_IN_FLIGHT ||
+                 (int32_t)(window[i].id - window[oldest].id) < 0)) {
+                oldest = i;
+            }
+        }
+        if (oldest == OUTBOUND_QUEUE_MAX_IN_FLIGHT) {
+            return 0;
+        }
+        if (Transmit(oldest) != 0) {
+            return -1;
+        }
+        batchesResent++;
+    }
+}
+
+/// <summary>
+///     Returns whether a lane has batches that await a retry.
+/// </summary>
+static bool HasRetries(OutboundQueue_Lane lane)
+{
+    for (size_t i = 0; i < OUTBOUND_QUEUE_MAX_IN_FLIGHT; i++) {
+        if (window[i].state == InFlightState_AwaitingRetry && window[i].lane == lane) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int OutboundQueue_Init(const OutboundQueue_Config *config, OutboundQueue_SendHandler sendHandler)
+{
+    if (config->maxAttempts == 0 || ToNanoseconds(&config->confirmationTimeout) <= 0) {
+        Log_Debug("ERROR: Invalid outbound queue attempt count or confirmation timeout.\n");
+        return -1;
+    }
+    for (size_t i = 0; i < OutboundQueue_Lane_Count; i++) {
+        const OutboundQueue_LaneConfig *laneConfig = &config->lanes[i];
+        if (laneConfig->maxBatchSize > OUTBOUND_QUEUE_MAX_BATCH_SIZE ||
+            laneConfig->maxMessageCount > OUTBOUND_QUEUE_MAX_MESSAGES ||
+            laneConfig->maxMessageCount == 0 || laneConfig->maxInFlight == 0 ||
+            laneConfig->maxInFlight > OUTBOUND_QUEUE_MAX_IN_FLIGHT) {
+            Log_Debug("ERROR: Invalid outbound queue thresholds for lane %zu.\n", i);
+            return -1;
+        }
+        lanes[i].batchLength = 0;
+        lanes[i].messageCount = 0;
+        lanes[i].traceCount = 0;
+        lanes[i].context = 0;
+    }
+
+    queueConfig = *config;
+    queueSendHandler = sendHandler;
+    for (size_t i = 0; i < OUTBOUND_QUEUE_MAX_IN_FLIGHT; i++) {
+        window[i].state = InFlightState_Free;
+    }
+    windowCount = 0;
+    sendOrderHead = 0;
+    sendOrderCount = 0;
+    owedCount = 0;
+    return 0;
+}
+
+int OutboundQueue_Enqueue(OutboundQueue_Lane lane, const char *payload, size_t length,
+                          const LatencyTrace *trace, uint32_t context)
+{
+    OutboundLane *queue = &lanes[lane];
+    const OutboundQueue_LaneConfig *laneConfig = &queueConfig.lanes[lane];
+    // The opening bracket or separator before the message, and the closing bracket and null
+    // character after the batch.
+    size_t separatorLength = 1;
+    size_t closingLength = 2;
+    if (separatorLength + length + closingLength > laneConfig->maxBatchSize) {
+        Log_Debug("ERROR: Message of %zu bytes does not fit in a batch.\n", length);
+        return -1;
+    }
+
+    if (!OutboundQueue_FitsInBatch(lane, length) && OutboundQueue_Flush(lane) != 0) {
+        Log_Debug("WARNING: Outbound queue lane %d full; dropping message.\n", lane);
+        return -1;
+    }
+
+    if (queue->messageCount == 0) {
+        queue->oldestQueued = trace != NULL ? trace->send : LatencyTrace_Now();
+        queue->batch[queue->batchLength++] = '[';
+    } else {
+        queue->batch[queue->batchLength++] = ',';
+    }
+    memcpy(queue->batch + queue->batchLength, payload, length);
+    queue->batchLength += length;
+    queue->messageCount++;
+    if (trace != NULL) {
+        queue->traces[queue->traceCount++] = *trace;
+    }
+    if (context != 0) {
+        queue->context = context;
+    }
+
+    if (queue->messageCount == laneConfig->maxMessageCount ||
+        queue->batchLength + closingLength == laneConfig->maxBatchSize ||
+        ToNanoseconds(&laneConfig->maxAge) == 0) {
+        // A failed flush is retried when the next message is queued or the batch is due.
+        OutboundQueue_Flush(lane);
+    }
+    return 0;
+}
+
+bool OutboundQueue_FitsInBatch(OutboundQueue_Lane lane, size_t length)
+{
+    // The opening bracket or separator before the message, and the closing bracket and null
+    // character after the batch.
+    return lanes[lane].batchLength + 1 + length + 2 <= queueConfig.lanes[lane].maxBatchSize;
+}
+
+int OutboundQueue_FlushDue(const struct timespec *now)
+{
+    int result = 0;
+    for (OutboundQueue_Lane lane = 0; lane < OutboundQueue_Lane_Count; lane++) {
+        if (Retransmit(lane) != 0) {
+            result = -1;
+            continue;
+        }
+        if (lanes[lane].messageCount == 0) {
+            continue;
+        }
+        struct timespec deadline = GetDeadline(lane);
+        if (ToNanoseconds(now) >= ToNanoseconds(&deadline) && OutboundQueue_CanSend(lane) &&
+            OutboundQueue_Flush(lane) != 0) {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+bool OutboundQueue_GetFlushDeadline(struct timespec *deadline)
+{
+    bool found = false;
+    for (OutboundQueue_Lane lane = 0; lane < OutboundQueue_Lane_Count; lane++) {
+        struct timespec laneDeadline;
+        if (HasRetries(lane)) {
+            laneDeadline = LatencyTrace_Now();
+        } else if (lanes[lane].messageCount != 0 && OutboundQueue_CanSend(lane)) {
+            laneDeadline = GetDeadline(lane);
+        } else {
+            continue;
+        }
+        if (!found || ToNanoseconds(&laneDeadline) < ToNanoseconds(deadline)) {
+            *deadline = laneDeadline;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool OutboundQueue_CanSend(OutboundQueue_Lane lane)
+{
+    return windowCount < queueConfig.lanes[lane].maxInFlight;
+}
+
+int OutboundQueue_Flush(OutboundQueue_Lane lane)
+{
+    OutboundLane *queue = &lanes[lane];
+    if (queue->messageCount == 0) {
+        return 0;
+    }
+    if (!OutboundQueue_CanSend(lane)) {
+        return -1;
+    }
+
+    // Close the batch into a free place of the window, where it stays until it is confirmed.
+    size_t index = 0;
+    while (window[index].state != InFlightState_Free) {
+        index++;
+    }
+    InFlightBatch *inFlight = &window[index];
+    memcpy(inFlight->batch, queue->batch, queue->batchLength);
+    inFlight->batchLength = queue->batchLength;
+    inFlight->batch[inFlight->batchLength++] = ']';
+    inFlight->batch[inFlight->batchLength] = '\0';
+    inFlight->id = nextBatchId;
+    inFlight->lane = lane;
+    inFlight->context = queue->context;
+    inFlight->attempts = 0;
+    if (Transmit(index) != 0) {
+        inFlight->state = InFlightState_Free;
+        return -1;
+    }
+    nextBatchId++;
+    windowCount++;
+    batchesSent++;
+
+    for (size_t i = 0; i < queue->traceCount; i++) {
+        inFlight->traces[i] = queue->traces[i];
+        inFlight->traces[i].queued = inFlight->lastSent;
+        LatencyTrace_Submit(&inFlight->traces[i]);
+    }
+    inFlight->traceCount = queue->traceCount;
+
+    queue->batchLength = 0;
+    queue->messageCount = 0;
+    queue->traceCount = 0;
+    queue->context = 0;
+    return 0;
+}
+
+size_t OutboundQueue_GetQueuedCount(OutboundQueue_Lane lane)
+{
+    return lanes[lane].messageCount;
+}
+
+size_t OutboundQueue_GetInFlightCount(void)
+{
+    return windowCount;
+}
+
+/// <summary>
+///     Removes the oldest batch from the send order, and records its outcome.
+/// </summary>
+/// <summary>
+///     Records that the SDK still owes the confirmation of a send whose batch no longer waits
+///     for it. The oldest owed confirmation is forgotten if there are too many.
+/// </summary>
+static void OweConfirmation(const struct timespec *sent)
+{
+    if (owedCount == MAX_OWED_CONFIRMATIONS) {
+        owedHead = (owedHead + 1) % MAX_OWED_CONFIRMATIONS;
+        owedCount--;
+    }
+    owedConfirmations[(owedHead + owedCount) % MAX_OWED_CONFIRMATIONS] = *sent;
+    owedCount++;
+}
+
+/// <summary>
+///     Forgets the owed confirmations of the sends older than twice the confirmation timeout,
+///     which the SDK dropped; their batches were sent again or completed meanwhile.
+/// </summary>
+static void ForgetOverdueConfirmations(const struct timespec *now)
+{
+    int64_t overdue = 2 * ToNanoseconds(&queueConfig.confirmationTimeout);
+    while (owedCount != 0 &&
+           ToNanoseconds(now) - ToNanoseconds(&owedConfirmations[owedHead]) >= overdue) {
+        owedHead = (owedHead + 1) % MAX_OWED_CONFIRMATIONS;
+        owedCount--;
+    }
+}
+
+static void CompleteOldest(bool delivered, OutboundQueue_Confirmation *confirmation)
+{
+    InFlightBatch *inFlight = &window[sendOrder[sendOrderHead]];
+    sendOrderHead = (sendOrderHead + 1) % OUTBOUND_QUEUE_MAX_IN_FLIGHT;
+    sendOrderCount--;
+
+    struct timespec now = LatencyTrace_Now();
+    confirmation->batchId = inFlight->id;
+    confirmation->lane = inFlight->lane;
+    confirmation->context = inFlight->context;
+    confirmation->attempts = inFlight->attempts;
+    confirmation->latencyMicroseconds = LatencyTrace_ElapsedMicroseconds(&inFlight->lastSent, &now);
+    confirmation->traces = inFlight->traces;
+    confirmation->traceCount = inFlight->traceCount;
+
+    if (delivered) {
+        LatencyHistogram_Record(&confirmationLatency, confirmation->latencyMicroseconds);
+        confirmation->outcome = OutboundQueue_Outcome_Delivered;
+    } else if (inFlight->attempts < queueConfig.maxAttempts) {
+        confirmation->outcome = OutboundQueue_Outcome_Retrying;
+        inFlight->state = InFlightState_AwaitingRetry;
+        return;
+    } else {
+        confirmation->outcome = OutboundQueue_Outcome_Failed;
+        batchesFailed++;
+    }
+
+    // The batch stays in place until the next call, for the traces of the confirmation.
+    inFlight->state = InFlightState_Free;
+    windowCount--;
+}
+
+int OutboundQueue_Confirm(bool delivered, OutboundQueue_Confirmation *confirmation)
+{
+    // The confirmations owed for earlier sends arrive first, as the SDK confirms in send order.
+    struct timespec now = LatencyTrace_Now();
+    ForgetOverdueConfirmations(&now);
+    if (owedCount != 0) {
+        owedHead = (owedHead + 1) % MAX_OWED_CONFIRMATIONS;
+        owedCount--;
+        lateConfirmations++;
+        return 1;
+    }
+
+    if (sendOrderCount == 0) {
+        unmatchedConfirmations++;
+        return -1;
+    }
+
+    CompleteOldest(delivered, confirmation);
+    return 0;
+}
+
+int OutboundQueue_ExpireConfirmation(const struct timespec *now,
+                                     OutboundQueue_Confirmation *confirmation)
+{
+    ForgetOverdueConfirmations(now);
+    if (sendOrderCount == 0) {
+        return -1;
+    }
+
+    const InFlightBatch *oldest = &window[sendOrder[sendOrderHead]];
+    if (ToNanoseconds(now) - ToNanoseconds(&oldest->lastSent) <
+        ToNanoseconds(&queueConfig.confirmationTimeout)) {
+        return -1;
+    }
+
+    batchesExpired++;
+    OweConfirmation(&oldest->lastSent);
+    CompleteOldest(false, confirmation);
+    return 0;
+}
+
+void OutboundQueue_RequeueInFlight(void)
+{
+    for (; sendOrderCount != 0; sendOrderCount--) {
+        InFlightBatch *inFlight = &window[sendOrder[sendOrderHead]];
+        inFlight->state = InFlightState_AwaitingRetry;
+        OweConfirmation(&inFlight->lastSent);
+        sendOrderHead = (sendOrderHead + 1) % OUTBOUND_QUEUE_MAX_IN_FLIGHT;
+    }
+}
+
+void OutboundQueue_LogSummary(void)
+{
+    LatencyHistogram_LogSummary("batch confirmation", &confirmationLatency);
+    Log_Debug("INFO: Outbound queue: %u batches sent, %u resent, %u failed, %u timed out, %u "
+              "late and %u unmatched confirmations.\n",
+              batchesSent, batchesResent, batchesFailed, batchesExpired, lateConfirmations,
+              unmatchedConfirmations);
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "latency_trace.h"
+
+/// <summary>
+///     Maximum size of a batched message, including the enclosing brackets and the terminating
+///     null character.
+/// </summary>
+#define OUTBOUND_QUEUE_MAX_BATCH_SIZE 2048
+
+/// <summary>
+///     Maximum number of messages in one batched message.
+/// </summary>
+#define OUTBOUND_QUEUE_MAX_MESSAGES 8
+
+/// <summary>
+///     Size of the in-flight window: the batches sent and not yet confirmed, each kept until
+///     its confirmation so that it can be sent again. No batch is sent while the window is
+///     full, which bounds the memory the IoT Hub SDK holds for unconfirmed messages.
+/// </summary>
+#define OUTBOUND_QUEUE_MAX_IN_FLIGHT 8
+
+/// <summary>
+///     Outbound lanes, from the highest priority to the lowest. Each lane accumulates its own
+///     batches, and the batches of a lane are never sent before those of a higher lane that
+///     are due.
+/// </summary>
+typedef enum {
+    /// <summary>Messages a user is waiting for, such as easy button presses.</summary>
+    OutboundQueue_Lane_Interactive = 0,
+    /// <summary>Bulk telemetry, such as the messages logged while offline.</summary>
+    OutboundQueue_Lane_Telemetry,
+    /// <summary>Diagnostics of the device itself.</summary>
+    OutboundQueue_Lane_Diagnostics,
+    OutboundQueue_Lane_Count
+} OutboundQueue_Lane;
+
+/// <summary>
+///     Thresholds at which the queued messages of a lane are sent as one batch, and the share
+///     of the in-flight batches the lane may use.
+/// </summary>
+typedef struct OutboundQueue_LaneConfig {
+    /// <summary>Size of the batched message, at most OUTBOUND_QUEUE_MAX_BATCH_SIZE.</summary>
+    size_t maxBatchSize;
+    /// <summary>Number of queued messages, at most OUTBOUND_QUEUE_MAX_MESSAGES.</summary>
+    size_t maxMessageCount;
+    /// <summary>Age of the oldest queued message; zero sends each message as soon as it is
+    /// queued.</summary>
+    struct timespec maxAge;
+    /// <summary>The lane sends a batch only while fewer batches than this, from all lanes,
+    /// are in the in-flight window, which bounds how many batches of the lane the SDK can hold in
+    /// front of a higher priority message. A lane with OUTBOUND_QUEUE_MAX_IN_FLIGHT is held back
+    /// only by a full window.</summary>
+    size_t maxInFlight;
+} OutboundQueue_LaneConfig;
+
+/// <summary>
+///     Retries, and configuration of each lane.
+/// </summary>
+typedef struct OutboundQueue_Config {
+    /// <summary>Number of times a batch is sent before a negative confirmation drops it.</summary>
+    unsigned int maxAttempts;
+    /// <summary>Time after which a batch that was not confirmed is treated as not delivered;
+    /// longer than the message timeout of the IoT Hub SDK, so that it only catches the
+    /// messages the SDK never confirms.</summary>
+    struct timespec confirmationTimeout;
+    OutboundQueue_LaneConfig lanes[OutboundQueue_Lane_Count];
+} OutboundQueue_Config;
+
+/// <summary>
+///     Outcomes of a confirmation.
+/// </summary>
+typedef enum {
+    /// <summary>The batch was delivered.</summary>
+    OutboundQueue_Outcome_Delivered = 0,
+    /// <summary>The batch was not delivered, and is sent again with its lane.</summary>
+    OutboundQueue_Outcome_Retrying,
+    /// <summary>The batch was not delivered after OutboundQueue_Config.maxAttempts sends, and
+    /// is dropped.</summary>
+    OutboundQueue_Outcome_Failed
+} OutboundQueue_Outcome;
+
+/// <summary>
+///     A confirmation, matched to the batch it is for.
+/// </summary>
+typedef struct OutboundQueue_Confirmation {
+    /// <summary>Identifier of the batch, allocated when it was first sent.</summary>
+    uint32_t batchId;
+    OutboundQueue_Lane lane;
+    OutboundQueue_Outcome outcome;
+    /// <summary>Number of times the batch was sent.</summary>
+    unsigned int attempts;
+    /// <summary>The context of the last message of the batch that was queued with one, or
+    /// 0.</summary>
+    uint32_t context;
+    /// <summary>Time from the last send of the batch to the confirmation.</summary>
+    uint64_t latencyMicroseconds;
+    /// <summary>The traces of the traced messages of the batch; valid until the next call to
+    /// the outbound queue.</summary>
+    const LatencyTrace *traces;
+    size_t traceCount;
+} OutboundQueue_Confirmation;
+
+/// <summary>
+///     Function called to send a batched message to the IoT Hub.
+/// </summary>
+/// <param name="batch">The messages, as a null-terminated JSON array.</param>
+/// <returns>true if the message was handed to the IoT Hub SDK, false to keep the messages
+/// queued.</returns>
+typedef bool (*OutboundQueue_SendHandler)(const char *batch);
+
+/// <summary>
+///     Initializes the outbound queue. Messages are accumulated into a single JSON array per
+///     lane and sent as one device-to-cloud message, which saves the per-message protocol
+///     overhead.
+/// </summary>
+/// <param name="config">The retries and the configuration of the lanes.</param>
+/// <param name="sendHandler">The function that sends a batch.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int OutboundQueue_Init(const OutboundQueue_Config *config, OutboundQueue_SendHandler sendHandler);
+
+/// <summary>
+///     Queues a message in a lane. The queued messages of the lane are flushed first if the
+///     message does not fit in the current batch, and afterwards if the batch reached its size
+///     or message count threshold, or if the lane has no age threshold.
+/// </summary>
+/// <param name="lane">The lane of the message.</param>
+/// <param name="payload">The message, a JSON value.</param>
+/// <param name="length">The length of the message.</param>
+/// <param name="trace">The latency trace of the message, with its 'send' timestamp set; it is
+/// submitted when the batch carrying the message is sent. May be NULL for an untraced
+/// message.</param>
+/// <param name="context">A value that the batch carrying the message reports with its
+/// confirmation, such as the position of the message in the message log, or 0 for none. A
+/// batch reports the context of the last of its messages that has one.</param>
+/// <returns>0 on success, or -1 if the message could not be queued.</returns>
+int OutboundQueue_Enqueue(OutboundQueue_Lane lane, const char *payload, size_t length,
+                          const LatencyTrace *trace, uint32_t context);
+
+/// <summary>
+///     Returns whether a message fits in the batch being accumulated in a lane, so that
+///     OutboundQueue_Enqueue does not send that batch before queuing it.
+/// </summary>
+/// <param name="lane">The lane.</param>
+/// <param name="length">The length of the message.</param>
+bool OutboundQueue_FitsInBatch(OutboundQueue_Lane lane, size_t length);
+
+/// <summary>
+///     Lane by lane from the highest priority, sends again the batches of the lane that await a
+///     retry, then its batch if its oldest message reached the age threshold, as far as the
+///     in-flight limits of the lanes allow.
+/// </summary>
+/// <param name="now">CLOCK_MONOTONIC current time.</param>
+/// <returns>0 on success, or -1 if a due batch could not be sent and stays queued.</returns>
+int OutboundQueue_FlushDue(const struct timespec *now);
+
+/// <summary>
+///     Gets the earliest time at which a batch that the in-flight limits allow to send becomes
+///     due; batches awaiting a retry are due immediately. Lanes held back by their limit are
+///     not considered; a confirmation frees them.
+/// </summary>
+/// <param name="deadline">Receives the CLOCK_MONOTONIC time of the deadline.</param>
+/// <returns>true if such a batch is queued, false otherwise.</returns>
+bool OutboundQueue_GetFlushDeadline(struct timespec *deadline);
+
+/// <summary>
+///     Returns whether a lane may send a batch under its in-flight limit.
+/// </summary>
+/// <param name="lane">The lane.</param>
+bool OutboundQueue_CanSend(OutboundQueue_Lane lane);
+
+/// <summary>
+///     Sends the queued messages of a lane as one batch, if any and if its in-flight limit
+///     allows it.
+/// </summary>
+/// <param name="lane">The lane.</param>
+/// <returns>0 on success or if nothing was queued, -1 if the batch could not be sent and
+/// stays queued.</returns>
+int OutboundQueue_Flush(OutboundQueue_Lane lane);
+
+/// <summary>
+///     Returns the number of messages queued in a lane.
+/// </summary>
+/// <param name="lane">The lane.</param>
+size_t OutboundQueue_GetQueuedCount(OutboundQueue_Lane lane);
+
+/// <summary>
+///     Returns the number of batches in the window: sent and waiting for a confirmation, or
+///     waiting to be sent again.
+/// </summary>
+size_t OutboundQueue_GetInFlightCount(void);
+
+/// <summary>
+///     Matches a confirmation to the batch it is for. The confirmation callback of the SDK
+///     carries no message context, so confirmations are matched to batches in send order,
+///     resends included. A delivered or failed batch frees its place in the window; a batch
+///     that is retried keeps it.
+/// </summary>
+/// <param name="delivered">Whether the IoT Hub confirmed delivery of the batch.</param>
+/// <param name="confirmation">Receives the batch and the outcome.</param>
+/// <returns>0 on success, 1 if the confirmation was discarded as the late confirmation of a
+/// send that timed out or was requeued, or -1 if no batch was waiting for a
+/// confirmation.</returns>
+int OutboundQueue_Confirm(bool delivered, OutboundQueue_Confirmation *confirmation);
+
+/// <summary>
+///     Treats the oldest batch waiting for a confirmation as not delivered if it has waited
+///     longer than the confirmation timeout, e.g. because the SDK dropped it without a
+///     confirmation. The SDK may still confirm that send; its confirmation is then discarded,
+///     unless it arrives more than twice the confirmation timeout after the send.
+/// </summary>
+/// <param name="now">CLOCK_MONOTONIC current time.</param>
+/// <param name="confirmation">Receives the batch and the outcome, as for
+/// OutboundQueue_Confirm.</param>
+/// <returns>0 if a batch timed out, or -1 otherwise.</returns>
+int OutboundQueue_ExpireConfirmation(const struct timespec *now,
+                                     OutboundQueue_Confirmation *confirmation);
+
+/// <summary>
+///     Makes every batch waiting for a confirmation due for a retry; used when the connection is
+///     lost, after which their confirmations may be late or never arrive. The confirmations of
+///     those sends are discarded, as for OutboundQueue_ExpireConfirmation.
+/// </summary>
+void OutboundQueue_RequeueInFlight(void);
+
+/// <summary>
+///     Logs the send counters and the histogram of the confirmation latency.
+/// </summary>
+void OutboundQueue_LogSummary(void);
@@ -55,9 +55,11 @@
 
 #define SIZEOF_TOKEN(a) (sizeof(a) - 1)
 #define SKIP_CHAR(str) ((*str)++)
-#define SKIP_WHITESPACES(str)                 \
-    while (isspace((unsigned char)(**str))) { \
-        SKIP_CHAR(str);                       \
+/* Current character of a bounded string, '\0' past its end */
+#define PEEK_CHAR(str, end) (*(str) < (end) ? **(str) : '\0')
+#define SKIP_WHITESPACES(str, end)                                \
+    while (*(str) < (end) && isspace((unsigned char)(**(str)))) { \
+        SKIP_CHAR(str);                                           \
     }
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
@@ -105,7 +107,7 @@ static void remove_comments(char *string, const char *start_token, const char *e
 static char *parson_strndup(const char *string, size_t n);
 static char *parson_strdup(const char *string);
 static int hex_char_to_int(char c);
-static int parse_utf16_hex(const char *string, unsigned int *result);
+static int parse_utf16_hex(const char *string, const char *end, unsigned int *result);
 static int num_bytes_in_utf8_sequence(unsigned char c);
 static int verify_utf8_sequence(const unsigned char *string, int *len);
 static int is_valid_utf8(const char *string, size_t string_len);
@@ -135,17 +137,17 @@ static void json_array_free(JSON_Array *array);
 static JSON_Value *json_value_init_string_no_copy(char *string);
 
 /* Parser */
-static JSON_Status skip_quotes(const char **string);
-static int parse_utf16(const char **unprocessed, char **processed);
+static JSON_Status skip_quotes(const char **string, const char *end);
+static int parse_utf16(const char **unprocessed, const char *end, char **processed);
 static char *process_string(const char *input, size_t len);
-static char *get_quoted_string(const char **string);
-static JSON_Value *parse_object_value(const char **string, size_t nesting);
-static JSON_Value *parse_array_value(const char **string, size_t nesting);
-static JSON_Value *parse_string_value(const char **string);
-static JSON_Value *parse_boolean_value(const char **string);
-static JSON_Value *parse_number_value(const char **string);
-static JSON_Value *parse_null_value(const char **string);
-static JSON_Value *parse_value(const char **string, size_t nesting);
+static char *get_quoted_string(const char **string, const char *end);
+static JSON_Value *parse_object_value(const char **string, const char *end, size_t nesting);
+static JSON_Value *parse_array_value(const char **string, const char *end, size_t nesting);
+static JSON_Value *parse_string_value(const char **string, const char *end);
+static JSON_Value *parse_boolean_value(const char **string, const char *end);
+static JSON_Value *parse_number_value(const char **string, const char *end);
+static JSON_Value *parse_null_value(const char **string, const char *end);
+static JSON_Value *parse_value(const char **string, const char *end, size_t nesting);
 
 /* Serialization */
 static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int level, int is_pretty,
@@ -183,10 +185,10 @@ static int hex_char_to_int(char c)
     return -1;
 }
 
-static int parse_utf16_hex(const char *s, unsigned int *result)
+static int parse_utf16_hex(const char *s, const char *end, unsigned int *result)
 {
     int x1, x2, x3, x4;
-    if (s[0] == '\0' || s[1] == '\0' || s[2] == '\0' || s[3] == '\0') {
+    if (end - s < 4 || s[0] == '\0' || s[1] == '\0' || s[2] == '\0' || s[3] == '\0') {
         return 0;
     }
     x1 = hex_char_to_int(s[0]);
@@ -543,18 +545,18 @@ static JSON_Value *json_value_init_string_no_copy(char *string)
 }
 
 /* Parser */
-static JSON_Status skip_quotes(const char **string)
+static JSON_Status skip_quotes(const char **string, const char *end)
 {
-    if (**string != '\"') {
+    if (PEEK_CHAR(string, end) != '\"') {
         return JSONFailure;
     }
     SKIP_CHAR(string);
-    while (**string != '\"') {
-        if (**string == '\0') {
+    while (PEEK_CHAR(string, end) != '\"') {
+        if (PEEK_CHAR(string, end) == '\0') {
             return JSONFailure;
         } else if (**string == '\\') {
             SKIP_CHAR(string);
-            if (**string == '\0') {
+            if (PEEK_CHAR(string, end) == '\0') {
                 return JSONFailure;
             }
         }
@@ -564,14 +566,14 @@ static JSON_Status skip_quotes(const char **string)
     return JSONSuccess;
 }
 
-static int parse_utf16(const char **unprocessed, char **processed)
+static int parse_utf16(const char **unprocessed, const char *end, char **processed)
 {
     unsigned int cp, lead, trail;
     int parse_succeeded = 0;
     char *processed_ptr = *processed;
     const char *unprocessed_ptr = *unprocessed;
     unprocessed_ptr++; /* skips u */
-    parse_succeeded = parse_utf16_hex(unprocessed_ptr, &cp);
+    parse_succeeded = parse_utf16_hex(unprocessed_ptr, end, &cp);
     if (!parse_succeeded) {
         return JSONFailure;
     }
@@ -590,10 +592,11 @@ static int parse_utf16(const char **unprocessed, char **processed)
         lead = cp;
         unprocessed_ptr +=
             4; /* should always be within the buffer, otherwise previous sscanf would fail */
-        if (*unprocessed_ptr++ != '\\' || *unprocessed_ptr++ != 'u') {
+        if (end - unprocessed_ptr < 2 || *unprocessed_ptr++ != '\\' ||
+            *unprocessed_ptr++ != 'u') {
             return JSONFailure;
         }
-        parse_succeeded = parse_utf16_hex(unprocessed_ptr, &trail);
+        parse_succeeded = parse_utf16_hex(unprocessed_ptr, end, &trail);
         if (!parse_succeeded || trail < 0xDC00 ||
             trail > 0xDFFF) { /* valid trail surrogate? (0xDC00..0xDFFF) */
             return JSONFailure;
@@ -618,6 +621,7 @@ Example: "\u006Corem ipsum" -> lorem ipsum */
 static char *process_string(const char *input, size_t len)
 {
     const char *input_ptr = input;
+    const char *input_end = input + len;
     size_t initial_size = (len + 1) * sizeof(char);
     size_t final_size = 0;
     char *output = NULL, *output_ptr = NULL, *resized_output = NULL;
@@ -626,10 +630,10 @@ static char *process_string(const char *input, size_t len)
         goto error;
     }
     output_ptr = output;
-    while ((*input_ptr != '\0') && (size_t)(input_ptr - input) < len) {
+    while (input_ptr < input_end && *input_ptr != '\0') {
         if (*input_ptr == '\\') {
             input_ptr++;
-            switch (*input_ptr) {
+            switch (PEEK_CHAR(&input_ptr, input_end)) {
             case '\"':
                 *output_ptr = '\"';
                 break;
@@ -655,7 +659,7 @@ static char *process_string(const char *input, size_t len)
                 *output_ptr = '\t';
                 break;
             case 'u':
-                if (parse_utf16(&input_ptr, &output_ptr) == JSONFailure) {
+                if (parse_utf16(&input_ptr, input_end, &output_ptr) == JSONFailure) {
                     goto error;
                 }
                 break;
@@ -689,11 +693,11 @@ error:
 
 /* Return processed contents of a string between quotes and
    skips passed argument to a matching quote. */
-static char *get_quoted_string(const char **string)
+static char *get_quoted_string(const char **string, const char *end)
 {
     const char *string_start = *string;
     size_t string_len = 0;
-    JSON_Status status = skip_quotes(string);
+    JSON_Status status = skip_quotes(string, end);
     if (status != JSONSuccess) {
         return NULL;
     }
@@ -701,22 +705,22 @@ static char *get_quoted_string(const char **string)
     return process_string(string_start + 1, string_len);
 }
 
-static JSON_Value *parse_value(const char **string, size_t nesting)
+static JSON_Value *parse_value(const char **string, const char *end, size_t nesting)
 {
     if (nesting > MAX_NESTING) {
         return NULL;
     }
-    SKIP_WHITESPACES(string);
-    switch (**string) {
+    SKIP_WHITESPACES(string, end);
+    switch (PEEK_CHAR(string, end)) {
     case '{':
-        return parse_object_value(string, nesting + 1);
+        return parse_object_value(string, end, nesting + 1);
     case '[':
-        return parse_array_value(string, nesting + 1);
+        return parse_array_value(string, end, nesting + 1);
     case '\"':
-        return parse_string_value(string);
+        return parse_string_value(string, end);
     case 'f':
     case 't':
-        return parse_boolean_value(string);
+        return parse_boolean_value(string, end);
     case '-':
     case '0':
     case '1':
@@ -728,15 +732,15 @@ static JSON_Value *parse_value(const char **string, size_t nesting)
     case '7':
     case '8':
     case '9':
-        return parse_number_value(string);
+        return parse_number_value(string, end);
     case 'n':
-        return parse_null_value(string);
+        return parse_null_value(string, end);
     default:
         return NULL;
     }
 }
 
-static JSON_Value *parse_object_value(const char **string, size_t nesting)
+static JSON_Value *parse_object_value(const char **string, const char *end, size_t nesting)
 {
     JSON_Value *output_value = NULL, *new_value = NULL;
     JSON_Object *output_object = NULL;
@@ -745,31 +749,31 @@ static JSON_Value *parse_object_value(const char **string, size_t nesting)
     if (output_value == NULL) {
         return NULL;
     }
-    if (**string != '{') {
+    if (PEEK_CHAR(string, end) != '{') {
         json_value_free(output_value);
         return NULL;
     }
     output_object = json_value_get_object(output_value);
     SKIP_CHAR(string);
-    SKIP_WHITESPACES(string);
-    if (**string == '}') { /* empty object */
+    SKIP_WHITESPACES(string, end);
+    if (PEEK_CHAR(string, end) == '}') { /* empty object */
         SKIP_CHAR(string);
         return output_value;
     }
-    while (**string != '\0') {
-        new_key = get_quoted_string(string);
+    while (PEEK_CHAR(string, end) != '\0') {
+        new_key = get_quoted_string(string, end);
         if (new_key == NULL) {
             json_value_free(output_value);
             return NULL;
         }
-        SKIP_WHITESPACES(string);
-        if (**string != ':') {
+        SKIP_WHITESPACES(string, end);
+        if (PEEK_CHAR(string, end) != ':') {
             parson_free(new_key);
             json_value_free(output_value);
             return NULL;
         }
         SKIP_CHAR(string);
-        new_value = parse_value(string, nesting);
+        new_value = parse_value(string, end, nesting);
         if (new_value == NULL) {
             parson_free(new_key);
             json_value_free(output_value);
@@ -782,15 +786,15 @@ static JSON_Value *parse_object_value(const char **string, size_t nesting)
             return NULL;
         }
         parson_free(new_key);
-        SKIP_WHITESPACES(string);
-        if (**string != ',') {
+        SKIP_WHITESPACES(string, end);
+        if (PEEK_CHAR(string, end) != ',') {
             break;
         }
         SKIP_CHAR(string);
-        SKIP_WHITESPACES(string);
+        SKIP_WHITESPACES(string, end);
     }
-    SKIP_WHITESPACES(string);
-    if (**string != '}' || /* Trim object after parsing is over */
+    SKIP_WHITESPACES(string, end);
+    if (PEEK_CHAR(string, end) != '}' || /* Trim object after parsing is over */
         json_object_resize(output_object, json_object_get_count(output_object)) == JSONFailure) {
         json_value_free(output_value);
         return NULL;
@@ -799,7 +803,7 @@ static JSON_Value *parse_object_value(const char **string, size_t nesting)
     return output_value;
 }
 
-static JSON_Value *parse_array_value(const char **string, size_t nesting)
+static JSON_Value *parse_array_value(const char **string, const char *end, size_t nesting)
 {
     JSON_Value *output_value = NULL, *new_array_value = NULL;
     JSON_Array *output_array = NULL;
@@ -807,19 +811,19 @@ static JSON_Value *parse_array_value(const char **string, size_t nesting)
     if (output_value == NULL) {
         return NULL;
     }
-    if (**string != '[') {
+    if (PEEK_CHAR(string, end) != '[') {
         json_value_free(output_value);
         return NULL;
     }
     output_array = json_value_get_array(output_value);
     SKIP_CHAR(string);
-    SKIP_WHITESPACES(string);
-    if (**string == ']') { /* empty array */
+    SKIP_WHITESPACES(string, end);
+    if (PEEK_CHAR(string, end) == ']') { /* empty array */
         SKIP_CHAR(string);
         return output_value;
     }
-    while (**string != '\0') {
-        new_array_value = parse_value(string, nesting);
+    while (PEEK_CHAR(string, end) != '\0') {
+        new_array_value = parse_value(string, end, nesting);
         if (new_array_value == NULL) {
             json_value_free(output_value);
             return NULL;
@@ -829,15 +833,15 @@ static JSON_Value *parse_array_value(const char **string, size_t nesting)
             json_value_free(output_value);
             return NULL;
         }
-        SKIP_WHITESPACES(string);
-        if (**string != ',') {
+        SKIP_WHITESPACES(string, end);
+        if (PEEK_CHAR(string, end) != ',') {
             break;
         }
         SKIP_CHAR(string);
-        SKIP_WHITESPACES(string);
+        SKIP_WHITESPACES(string, end);
     }
-    SKIP_WHITESPACES(string);
-    if (**string != ']' || /* Trim array after parsing is over */
+    SKIP_WHITESPACES(string, end);
+    if (PEEK_CHAR(string, end) != ']' || /* Trim array after parsing is over */
         json_array_resize(output_array, json_array_get_count(output_array)) == JSONFailure) {
         json_value_free(output_value);
         return NULL;
@@ -846,10 +850,10 @@ static JSON_Value *parse_array_value(const char **string, size_t nesting)
     return output_value;
 }
 
-static JSON_Value *parse_string_value(const char **string)
+static JSON_Value *parse_string_value(const char **string, const char *end)
 {
     JSON_Value *value = NULL;
-    char *new_string = get_quoted_string(string);
+    char *new_string = get_quoted_string(string, end);
     if (new_string == NULL) {
         return NULL;
     }
@@ -861,37 +865,61 @@ static JSON_Value *parse_string_value(const char **string)
     return value;
 }
 
-static JSON_Value *parse_boolean_value(const char **string)
+static JSON_Value *parse_boolean_value(const char **string, const char *end)
 {
     size_t true_token_size = SIZEOF_TOKEN("true");
     size_t false_token_size = SIZEOF_TOKEN("false");
-    if (strncmp("true", *string, true_token_size) == 0) {
+    size_t remaining = (size_t)(end - *string);
+    if (remaining >= true_token_size && strncmp("true", *string, true_token_size) == 0) {
         *string += true_token_size;
         return json_value_init_boolean(1);
-    } else if (strncmp("false", *string, false_token_size) == 0) {
+    } else if (remaining >= false_token_size &&
+               strncmp("false", *string, false_token_size) == 0) {
         *string += false_token_size;
         return json_value_init_boolean(0);
     }
     return NULL;
 }
 
-static JSON_Value *parse_number_value(const char **string)
+static JSON_Value *parse_number_value(const char **string, const char *end)
 {
-    char *end;
+    /* strtod needs a terminated string, so the number is copied out of the bounded input; into
+     * a small stack buffer, or onto the heap when the number is longer */
+    char small_buf[NUM_BUF_SIZE];
+    char *num_buf = small_buf;
+    char *num_end;
+    size_t num_len = 0;
     double number = 0;
+    int is_valid = 0;
+    while (*string + num_len < end && (*string)[num_len] != '\0' &&
+           strchr("0123456789+-.eE", (*string)[num_len]) != NULL) {
+        num_len++;
+    }
+    if (num_len >= NUM_BUF_SIZE) {
+        num_buf = (char *)parson_malloc(num_len + 1);
+        if (num_buf == NULL) {
+            return NULL;
+        }
+    }
+    memcpy(num_buf, *string, num_len);
+    num_buf[num_len] = '\0';
     errno = 0;
-    number = strtod(*string, &end);
-    if (errno || !is_decimal(*string, (size_t)(end - *string))) {
+    number = strtod(num_buf, &num_end);
+    is_valid = !errno && is_decimal(num_buf, (size_t)(num_end - num_buf));
+    *string += is_valid ? num_end - num_buf : 0;
+    if (num_buf != small_buf) {
+        parson_free(num_buf);
+    }
+    if (!is_valid) {
         return NULL;
     }
-    *string = end;
     return json_value_init_number(number);
 }
 
-static JSON_Value *parse_null_value(const char **string)
+static JSON_Value *parse_null_value(const char **string, const char *end)
 {
     size_t token_size = SIZEOF_TOKEN("null");
-    if (strncmp("null", *string, token_size) == 0) {
+    if ((size_t)(end - *string) >= token_size && strncmp("null", *string, token_size) == 0) {
         *string += token_size;
         return json_value_init_null();
     }
@@ -1219,10 +1247,20 @@ JSON_Value *json_parse_string(const char *string)
     if (string == NULL) {
         return NULL;
     }
-    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+    return json_parse_stringn(string, strlen(string));
+}
+
+JSON_Value *json_parse_stringn(const char *string, size_t string_len)
+{
+    const char *end = NULL;
+    if (string == NULL) {
+        return NULL;
+    }
+    end = string + string_len;
+    if (string_len >= 3 && string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
         string = string + 3; /* Support for UTF-8 BOM */
     }
-    return parse_value((const char **)&string, 0);
+    return parse_value((const char **)&string, end, 0);
 }
 
 JSON_Value *json_parse_string_with_comments(const char *string)
@@ -1236,7 +1274,8 @@ JSON_Value *json_parse_string_with_comments(const char *string)
     remove_comments(string_mutable_copy, "/*", "*/");
     remove_comments(string_mutable_copy, "//", "\n");
     string_mutable_copy_ptr = string_mutable_copy;
-    result = parse_value((const char **)&string_mutable_copy_ptr, 0);
+    result = parse_value((const char **)&string_mutable_copy_ptr,
+                         string_mutable_copy + strlen(string_mutable_copy), 0);
     parson_free(string_mutable_copy);
     return result;
 }
@@ -66,6 +66,10 @@ void json_set_allocation_functions(JSON_Malloc_Function malloc_fun, JSON_Free_Fu
 /*  Parses first JSON value in a string, returns NULL in case of error */
 JSON_Value *json_parse_string(const char *string);
 
+/*  Parses first JSON value in the first string_len characters of a string, which does not need to
+    be null terminated. Nothing past string + string_len is read. Returns NULL in case of error */
+JSON_Value *json_parse_stringn(const char *string, size_t string_len);
+
 /*  Parses first JSON value in a string and ignores comments (/ * * / and //),
     returns NULL in case of error */
 JSON_Value *json_parse_string_with_comments(const char *string);
@@ -0,0 +1,148 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "press_aggregator.h"
+
+static int64_t ToNanoseconds(const struct timespec *time)
+{
+    return (int64_t)time->tv_sec * 1000000000LL + time->tv_nsec;
+}
+
+static uint64_t ToMilliseconds(const struct timespec *time)
+{
+    return (uint64_t)ToNanoseconds(time) / 1000000;
+}
+
+/// <summary>
+///     Appends formatted text at 'length' in 'buffer' and advances 'length'.
+/// </summary>
+/// <returns>true if the text fitted in the buffer, false otherwise.</returns>
+static bool Append(char *buffer, size_t bufferSize, size_t *length, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer + *length, bufferSize - *length, format, args);
+    va_end(args);
+
+    if (written < 0 || (size_t)written >= bufferSize - *length) {
+        return false;
+    }
+    *length += (size_t)written;
+    return true;
+}
+
+void PressAggregator_Init(PressAggregator *aggregator, const PressAggregator_Config *config)
+{
+    aggregator->config = *config;
+    aggregator->count = 0;
+    aggregator->intervalCount = 0;
+    aggregator->opensWindow = false;
+    aggregator->hasEmitted = false;
+}
+
+/// <summary>
+///     Returns whether a press at the given time is within the window of the last press that
+///     opened one.
+/// </summary>
+static bool IsInWindow(const PressAggregator *aggregator, const struct timespec *timestamp)
+{
+    return aggregator->hasEmitted &&
+           ToNanoseconds(timestamp) - ToNanoseconds(&aggregator->windowStart) <
+               ToNanoseconds(&aggregator->config.window);
+}
+
+bool PressAggregator_Accepts(const PressAggregator *aggregator, const struct timespec *timestamp)
+{
+    return aggregator->count != 0 || IsInWindow(aggregator, timestamp);
+}
+
+bool PressAggregator_Add(PressAggregator *aggregator, const struct timespec *timestamp)
+{
+    if (aggregator->count == 0) {
+        aggregator->opensWindow = !IsInWindow(aggregator, timestamp);
+        if (aggregator->opensWindow) {
+            aggregator->windowStart = *timestamp;
+        }
+        aggregator->count = 1;
+        aggregator->first = *timestamp;
+        aggregator->last = *timestamp;
+        aggregator->intervalCount = 0;
+        return true;
+    }
+
+    if (aggregator->intervalCount < PRESS_AGGREGATOR_MAX_INTERVALS) {
+        int64_t interval = ToNanoseconds(timestamp) - ToNanoseconds(&aggregator->last);
+        aggregator->intervalsMs[aggregator->intervalCount++] =
+            interval > 0 ? (uint32_t)(interval / 1000000) : 0;
+    }
+    aggregator->count++;
+    aggregator->last = *timestamp;
+    return false;
+}
+
+/// <summary>
+///     Gets the CLOCK_MONOTONIC time, in nanoseconds, at which the open burst is due.
+/// </summary>
+static int64_t GetEmitTime(const PressAggregator *aggregator)
+{
+    int64_t emitAt = aggregator->opensWindow ? ToNanoseconds(&aggregator->first)
+                                             : ToNanoseconds(&aggregator->windowStart) +
+                                                   ToNanoseconds(&aggregator->config.window);
+    if (aggregator->hasEmitted) {
+        int64_t allowedAt = ToNanoseconds(&aggregator->lastEmit) +
+                            ToNanoseconds(&aggregator->config.minEmitInterval);
+        if (allowedAt > emitAt) {
+            emitAt = allowedAt;
+        }
+    }
+    return emitAt;
+}
+
+bool PressAggregator_IsDue(const PressAggregator *aggregator, const struct timespec *now)
+{
+    return GetEmitTime(aggregator) <= ToNanoseconds(now);
+}
+
+struct timespec PressAggregator_GetEmitDelay(const PressAggregator *aggregator,
+                                             const struct timespec *now)
+{
+    int64_t delay = GetEmitTime(aggregator) - ToNanoseconds(now);
+    if (delay <= 0) {
+        delay = 1; // A zero expiry would disarm the timer.
+    }
+
+    struct timespec result = {.tv_sec = (time_t)(delay / 1000000000LL),
+                              .tv_nsec = (long)(delay % 1000000000LL)};
+    return result;
+}
+
+/// <summary>
+///     Closes the emitted burst and records the emission time.
+/// </summary>
+static void CloseBurst(PressAggregator *aggregator, const struct timespec *now)
+{
+    aggregator->count = 0;
+    aggregator->intervalCount = 0;
+    aggregator->lastEmit = *now;
+    aggregator->hasEmitted = true;
+}
+
+bool PressAggregator_Emit(PressAggregator *aggregator, uint32_t traceId, const struct timespec *now,
+                          char *buffer, size_t bufferSize)
+{
+    size_t length = 0;
+    bool fits = Append(buffer, bufferSize, &length,
+                       "{\"message\":\"That was easy\",\"traceId\":%u,\"count\":%u,"
+                       "\"firstMs\":%llu,\"lastMs\":%llu,\"intervalsMs\":[",
+                       traceId, aggregator->count,
+                       (unsigned long long)ToMilliseconds(&aggregator->first),
+                       (unsigned long long)ToMilliseconds(&aggregator->last));
+    for (size_t i = 0; fits && i < aggregator->intervalCount; i++) {
+        fits = Append(buffer, bufferSize, &length, i == 0 ? "%u" : ",%u",
+                      aggregator->intervalsMs[i]);
+    }
+    fits = fits && Append(buffer, bufferSize, &length, "]}");
+
+    CloseBurst(aggregator, now);
+    return fits;
+}
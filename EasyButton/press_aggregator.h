@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/// <summary>
+///     Maximum number of inter-press intervals reported in one aggregated message.
+/// </summary>
+#define PRESS_AGGREGATOR_MAX_INTERVALS 16
+
+/// <summary>
+///     Configuration of a PressAggregator.
+/// </summary>
+typedef struct PressAggregator_Config {
+    /// <summary>Presses within this time of the press that opened the window are aggregated
+    /// into one message, emitted when the window ends. The press that opened it is emitted
+    /// right away.</summary>
+    struct timespec window;
+    /// <summary>Minimum time between two emitted messages.</summary>
+    struct timespec minEmitInterval;
+} PressAggregator_Config;
+
+/// <summary>
+///     Collects the presses of a burst so that they can be emitted as a single message.
+/// </summary>
+typedef struct PressAggregator {
+    PressAggregator_Config config;
+    /// <summary>Number of presses in the current burst; 0 when no burst is open.</summary>
+    uint32_t count;
+    struct timespec first;
+    struct timespec last;
+    /// <summary>Time of the press that opened the current aggregation window.</summary>
+    struct timespec windowStart;
+    /// <summary>Whether the open burst starts with the press that opened the window.</summary>
+    bool opensWindow;
+    /// <summary>Intervals between consecutive presses, in milliseconds.</summary>
+    uint32_t intervalsMs[PRESS_AGGREGATOR_MAX_INTERVALS];
+    size_t intervalCount;
+    /// <summary>Time of the last emission, used for rate limiting.</summary>
+    struct timespec lastEmit;
+    bool hasEmitted;
+} PressAggregator;
+
+/// <summary>
+///     Initializes an aggregator with no open burst.
+/// </summary>
+/// <param name="aggregator">The aggregator.</param>
+/// <param name="config">The aggregation window and emission rate limit.</param>
+void PressAggregator_Init(PressAggregator *aggregator, const PressAggregator_Config *config);
+
+/// <summary>
+///     Returns whether a press at the given time is aggregated: it joins the open burst, or
+///     follows the emitted press that opened the window. Once a burst is open, every press joins
+///     it until it is emitted, even after its window while the emission rate limit holds it
+///     back, so that the press is neither lost nor counted twice.
+/// </summary>
+/// <param name="aggregator">The aggregator.</param>
+/// <param name="timestamp">CLOCK_MONOTONIC time of the press.</param>
+bool PressAggregator_Accepts(const PressAggregator *aggregator, const struct timespec *timestamp);
+
+/// <summary>
+///     Adds a press to the current burst, opening a new burst if none is open; a burst opened
+///     outside the window of an earlier press also opens a new window.
+/// </summary>
+/// <param name="aggregator">The aggregator.</param>
+/// <param name="timestamp">CLOCK_MONOTONIC time of the press.</param>
+/// <returns>true if the press opened a new burst, false if it joined the open one.</returns>
+bool PressAggregator_Add(PressAggregator *aggregator, const struct timespec *timestamp);
+
+/// <summary>
+///     Returns whether the open burst is due now: a burst that opened the window is due right
+///     away, and one that follows it at the end of the window, both subject to the emission
+///     rate limit.
+/// </summary>
+/// <param name="aggregator">The aggregator, with an open burst.</param>
+/// <param name="now">The current CLOCK_MONOTONIC time.</param>
+bool PressAggregator_IsDue(const PressAggregator *aggregator, const struct timespec *now);
+
+/// <summary>
+///     Returns how long after 'now' the open burst must be emitted, taking both the aggregation
+///     window and the emission rate limit into account.
+/// </summary>
+/// <param name="aggregator">The aggregator, with an open burst.</param>
+/// <param name="now">The current CLOCK_MONOTONIC time.</param>
+/// <returns>The delay before emission; never zero, so that it can arm a timerfd.</returns>
+struct timespec PressAggregator_GetEmitDelay(const PressAggregator *aggregator,
+                                             const struct timespec *now);
+
+/// <summary>
+///     Formats the open burst as a JSON message and closes the burst.
+/// </summary>
+/// <param name="aggregator">The aggregator, with an open burst.</param>
+/// <param name="traceId">The latency trace ID of the first press of the burst.</param>
+/// <param name="now">The current CLOCK_MONOTONIC time, recorded as the emission time.</param>
+/// <param name="buffer">Receives the JSON message.</param>
+/// <param name="bufferSize">The size of 'buffer'.</param>
+/// <returns>true on success, false if the message did not fit in the buffer.</returns>
+bool PressAggregator_Emit(PressAggregator *aggregator, uint32_t traceId, const struct timespec *now,
+                          char *buffer, size_t bufferSize);
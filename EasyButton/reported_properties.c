@@ -0,0 +1,109 @@
+#include <string.h>
+
+#include <applibs/log.h>
+
+#include "epoll_timerfd_utilities.h"
+#include "reported_properties.h"
+
+typedef struct ReportedProperty {
+    const char *name;
+    size_t stagedValue;
+    size_t reportedValue;
+    bool isStaged;
+    bool isReported;
+} ReportedProperty;
+
+static ReportedProperty properties[REPORTED_PROPERTIES_MAX];
+static size_t propertyCount = 0;
+
+static ReportedProperties_ReportHandler propertiesReportHandler = NULL;
+static struct timespec propertiesFlushDelay;
+static int flushTimerFd = -1;
+static bool flushPending = false;
+
+static void FlushTimerHandler(event_data_t *eventData);
+static event_data_t flushTimerEventData = {.eventHandler = &FlushTimerHandler};
+
+static void FlushTimerHandler(event_data_t *eventData)
+{
+    if (ConsumeTimerFdEvent(flushTimerFd) != 0) {
+        return;
+    }
+
+    flushPending = false;
+    ReportedProperties_Flush();
+}
+
+int ReportedProperties_Init(int epollFd, const struct timespec *flushDelay,
+                            ReportedProperties_ReportHandler reportHandler)
+{
+    propertiesReportHandler = reportHandler;
+    propertiesFlushDelay = *flushDelay;
+    propertyCount = 0;
+    flushPending = false;
+
+    static const struct timespec nullPeriod = {0, 0};
+    flushTimerFd =
+        CreateTimerFdAndAddToEpoll(epollFd, &nullPeriod, &flushTimerEventData, EPOLLIN);
+    return flushTimerFd < 0 ? -1 : 0;
+}
+
+int ReportedProperties_Stage(const char *name, size_t value)
+{
+    ReportedProperty *property = NULL;
+    for (size_t i = 0; i < propertyCount; i++) {
+        if (properties[i].name == name || strcmp(properties[i].name, name) == 0) {
+            property = &properties[i];
+            break;
+        }
+    }
+
+    if (property == NULL) {
+        if (propertyCount == REPORTED_PROPERTIES_MAX) {
+            Log_Debug("ERROR: Cannot report more than %d properties.\n", REPORTED_PROPERTIES_MAX);
+            return -1;
+        }
+        property = &properties[propertyCount++];
+        *property = (ReportedProperty){.name = name};
+    }
+
+    // A change back to the value last reported cancels the staged one.
+    property->stagedValue = value;
+    property->isStaged = !property->isReported || property->reportedValue != value;
+
+    if (property->isStaged && !flushPending) {
+        // The deadline runs from the first change; later changes join the same flush.
+        if (SetTimerFdToSingleExpiry(flushTimerFd, &propertiesFlushDelay) != 0) {
+            return -1;
+        }
+        flushPending = true;
+    }
+    return 0;
+}
+
+int ReportedProperties_Flush(void)
+{
+    int result = 0;
+    for (size_t i = 0; i < propertyCount; i++) {
+        ReportedProperty *property = &properties[i];
+        if (!property->isStaged) {
+            continue;
+        }
+
+        if (!propertiesReportHandler(property->name, property->stagedValue)) {
+            result = -1;
+            continue;
+        }
+        property->reportedValue = property->stagedValue;
+        property->isReported = true;
+        property->isStaged = false;
+    }
+    return result;
+}
+
+void ReportedProperties_Close(void)
+{
+    CloseFdAndPrintError(flushTimerFd, "ReportedPropertiesFlushTimer");
+    flushTimerFd = -1;
+    flushPending = false;
+}
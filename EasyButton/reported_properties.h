@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+/// <summary>
+///     Maximum number of distinct reported properties.
+/// </summary>
+#define REPORTED_PROPERTIES_MAX 16
+
+/// <summary>
+///     Function called to report a property to the device twin.
+/// </summary>
+/// <param name="name">The name of the property.</param>
+/// <param name="value">The value of the property.</param>
+/// <returns>true if the property was handed to the IoT Hub SDK, false to keep it staged.</returns>
+typedef bool (*ReportedProperties_ReportHandler)(const char *name, size_t value);
+
+/// <summary>
+///     Initializes the staging area of the reported properties. Changes are collected and
+///     reported together once the flush delay has elapsed since the first of them, with only
+///     the last value of each property, and none for properties whose value is the one last
+///     reported.
+/// </summary>
+/// <param name="epollFd">The epoll instance on which the flush timer is registered.</param>
+/// <param name="flushDelay">The time from the first staged change to the flush.</param>
+/// <param name="reportHandler">The function that reports a property.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int ReportedProperties_Init(int epollFd, const struct timespec *flushDelay,
+                            ReportedProperties_ReportHandler reportHandler);
+
+/// <summary>
+///     Stages the value of a reported property, replacing any value staged for it.
+/// </summary>
+/// <param name="name">The name of the property; it must stay in memory.</param>
+/// <param name="value">The value of the property.</param>
+/// <returns>0 on success, or -1 if there is no room for the property.</returns>
+int ReportedProperties_Stage(const char *name, size_t value);
+
+/// <summary>
+///     Reports the staged properties now.
+/// </summary>
+/// <returns>0 on success, or -1 if some properties could not be reported and stay
+/// staged.</returns>
+int ReportedProperties_Flush(void);
+
+/// <summary>
+///     Closes the flush timer. Staged properties are not reported.
+/// </summary>
+void ReportedProperties_Close(void);
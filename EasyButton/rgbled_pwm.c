@@ -0,0 +1,320 @@
+#include <string.h>
+
+#include <applibs/gpio.h>
+#include <applibs/log.h>
+
+#include "epoll_timerfd_utilities.h"
+#include "rgbled_pwm.h"
+
+/// <summary>
+///     Number of duty-cycle slots in a PWM frame.
+/// </summary>
+#define PWM_SLOTS 256
+
+#define PWM_SLOT_NS (RGBLED_PWM_FRAME_PERIOD_NS / PWM_SLOTS)
+#define PWM_MAX_CHANNELS (RGBLED_PWM_MAX_LEDS * NUM_CHANNELS)
+
+_Static_assert(PWM_MAX_CHANNELS <= 32, "PWM channel masks must fit in 32 bits");
+
+/// <summary>
+///     Perceptual brightness to duty cycle (gamma 2.2).
+/// </summary>
+static const uint8_t gammaTable[PWM_SLOTS] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+     12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+     20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+     30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+     42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+     56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+     91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
+
+/// <summary>
+///     A point in the PWM frame at which a set of channels is switched off.
+/// </summary>
+typedef struct PwmStep {
+    uint32_t slot;
+    uint32_t clearMask;
+} PwmStep;
+
+/// <summary>
+///     Precomputed PWM frame: the channels switched on at the start of the frame, then the
+///     channels switched off at each step, in slot order.
+/// </summary>
+typedef struct PwmSchedule {
+    uint32_t onMask;
+    PwmStep steps[PWM_MAX_CHANNELS];
+    size_t stepCount;
+} PwmSchedule;
+
+static RgbLed *pwmLeds[RGBLED_PWM_MAX_LEDS];
+static size_t pwmLedCount = 0;
+static int pwmChannelFds[PWM_MAX_CHANNELS];
+static uint8_t channelDuty[PWM_MAX_CHANNELS];
+static uint32_t drivenMask = 0;
+static uint32_t litMask = 0;
+
+// The schedule being played, and the one rebuilt by RgbLedPwm_SetLevels, which replaces it at
+// the start of the next frame so that a frame is never played half old, half new.
+static PwmSchedule schedules[2];
+static int activeSchedule = 0;
+static bool scheduleChanged = false;
+
+static int pwmTimerFd = -1;
+static bool timerRunning = false;
+static struct timespec frameStart;
+static size_t nextStep = 0;
+
+static void PwmTimerHandler(event_data_t *eventData);
+static event_data_t pwmEventData = {.eventHandler = &PwmTimerHandler};
+
+static int64_t ToNanoseconds(const struct timespec *time)
+{
+    return (int64_t)time->tv_sec * 1000000000LL + time->tv_nsec;
+}
+
+static struct timespec FromNanoseconds(int64_t nanoseconds)
+{
+    struct timespec result = {.tv_sec = (time_t)(nanoseconds / 1000000000LL),
+                              .tv_nsec = (long)(nanoseconds % 1000000000LL)};
+    return result;
+}
+
+/// <summary>
+///     Sets the driven channels so that exactly those in 'newLitMask' are on, writing only the
+///     channels that change.
+/// </summary>
+static void ApplyLitMask(uint32_t newLitMask)
+{
+    uint32_t changed = (litMask ^ newLitMask) & drivenMask;
+
+    while (changed != 0) {
+        int channel = __builtin_ctz(changed);
+        changed &= changed - 1;
+
+        int fd = pwmChannelFds[channel];
+        bool isOn = (newLitMask & (1u << channel)) != 0;
+        if (GPIO_SetValue(fd, isOn ? GPIO_Value_Low : GPIO_Value_High) != 0) {
+            Log_Debug("ERROR: Cannot set PWM channel %d.\n", channel);
+        }
+    }
+
+    litMask = (litMask & ~drivenMask) | (newLitMask & drivenMask);
+}
+
+/// <summary>
+///     Builds the schedule of a frame from the duty cycle of the driven channels.
+/// </summary>
+static void BuildSchedule(PwmSchedule *schedule)
+{
+    memset(schedule, 0, sizeof(*schedule));
+
+    for (int channel = 0; channel < PWM_MAX_CHANNELS; channel++) {
+        if ((drivenMask & (1u << channel)) == 0 || channelDuty[channel] == 0) {
+            continue;
+        }
+
+        schedule->onMask |= 1u << channel;
+        if (channelDuty[channel] == PWM_SLOTS - 1) {
+            continue; // Fully on: never switched off.
+        }
+
+        // Insert the channel in the step of its slot, keeping the steps sorted by slot.
+        uint32_t slot = channelDuty[channel];
+        size_t i = 0;
+        while (i < schedule->stepCount && schedule->steps[i].slot < slot) {
+            i++;
+        }
+        if (i == schedule->stepCount || schedule->steps[i].slot != slot) {
+            memmove(&schedule->steps[i + 1], &schedule->steps[i],
+                    (schedule->stepCount - i) * sizeof(PwmStep));
+            schedule->steps[i].slot = slot;
+            schedule->steps[i].clearMask = 0;
+            schedule->stepCount++;
+        }
+        schedule->steps[i].clearMask |= 1u << channel;
+    }
+}
+
+/// <summary>
+///     Starts a new frame at 'start': switches on the channels of the active schedule.
+/// </summary>
+static void StartFrame(const struct timespec *start)
+{
+    if (scheduleChanged) {
+        activeSchedule = 1 - activeSchedule;
+        scheduleChanged = false;
+    }
+
+    frameStart = *start;
+    nextStep = 0;
+    ApplyLitMask(schedules[activeSchedule].onMask);
+}
+
+/// <summary>
+///     Arms the PWM timer for the next step or frame, or stops it when no channel needs it.
+/// </summary>
+static int ArmTimer(void)
+{
+    const PwmSchedule *schedule = &schedules[activeSchedule];
+
+    if (schedule->stepCount == 0 && !scheduleChanged) {
+        // Every channel is either off or fully on: nothing to do until the levels change.
+        timerRunning = false;
+        static const struct timespec disarm = {0, 0};
+        return SetTimerFdToSingleExpiry(pwmTimerFd, &disarm);
+    }
+
+    int64_t due = ToNanoseconds(&frameStart) +
+                  (nextStep < schedule->stepCount
+                       ? (int64_t)schedule->steps[nextStep].slot * PWM_SLOT_NS
+                       : RGBLED_PWM_FRAME_PERIOD_NS);
+    struct timespec expiry = FromNanoseconds(due);
+    timerRunning = true;
+    return SetTimerFdToAbsoluteExpiry(pwmTimerFd, &expiry);
+}
+
+static void PwmTimerHandler(event_data_t *eventData)
+{
+    if (ConsumeTimerFdEvent(pwmTimerFd) != 0) {
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t nowNs = ToNanoseconds(&now);
+
+    // Apply every step that is due. If the loop fell more than a frame behind, restart the
+    // frame now rather than replaying the missed ones.
+    for (;;) {
+        const PwmSchedule *schedule = &schedules[activeSchedule];
+        int64_t frameStartNs = ToNanoseconds(&frameStart);
+
+        if (nextStep < schedule->stepCount) {
+            if (frameStartNs + (int64_t)schedule->steps[nextStep].slot * PWM_SLOT_NS > nowNs) {
+                break;
+            }
+            ApplyLitMask(litMask & ~schedule->steps[nextStep].clearMask);
+            nextStep++;
+        } else {
+            int64_t nextFrameNs = frameStartNs + RGBLED_PWM_FRAME_PERIOD_NS;
+            if (nextFrameNs > nowNs) {
+                break;
+            }
+            struct timespec start =
+                FromNanoseconds(nowNs - nextFrameNs > RGBLED_PWM_FRAME_PERIOD_NS ? nowNs
+                                                                                 : nextFrameNs);
+            StartFrame(&start);
+        }
+    }
+
+    ArmTimer();
+}
+
+int RgbLedPwm_Init(int epollFd, RgbLed **leds, size_t ledCount)
+{
+    if (ledCount > RGBLED_PWM_MAX_LEDS) {
+        Log_Debug("ERROR: Cannot drive more than %d RGB LEDs with PWM.\n", RGBLED_PWM_MAX_LEDS);
+        return -1;
+    }
+
+    for (size_t i = 0; i < ledCount; i++) {
+        pwmLeds[i] = leds[i];
+        for (int channel = 0; channel < NUM_CHANNELS; channel++) {
+            pwmChannelFds[i * NUM_CHANNELS + channel] = RgbLedUtility_GetChannelFd(leds[i], channel);
+        }
+    }
+    pwmLedCount = ledCount;
+    drivenMask = 0;
+    litMask = 0;
+
+    static const struct timespec nullPeriod = {0, 0};
+    pwmTimerFd = CreateTimerFdAndAddToEpoll(epollFd, &nullPeriod, &pwmEventData, EPOLLIN);
+    if (pwmTimerFd < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int RgbLedPwm_SetLevels(size_t ledIndex, const RgbLedPwm_Levels *levels)
+{
+    if (ledIndex >= pwmLedCount) {
+        Log_Debug("ERROR: No PWM LED at index %zu.\n", ledIndex);
+        return -1;
+    }
+
+    RgbLed *led = pwmLeds[ledIndex];
+    uint32_t ledMask = ((1u << NUM_CHANNELS) - 1) << (ledIndex * NUM_CHANNELS);
+    if ((drivenMask & ledMask) == 0) {
+        // Take over the LED from RgbLedUtility_SetLed, starting from the color it shows.
+        RgbLedUtility_Colors color = RgbLedUtility_GetColor(led);
+        uint32_t shown = color == RgbLedUtility_Colors_Unknown ? 0 : (uint32_t)color;
+        litMask = (litMask & ~ledMask) | (shown << (ledIndex * NUM_CHANNELS));
+        drivenMask |= ledMask;
+        RgbLedUtility_InvalidateColor(led);
+        RgbLedUtility_DiscardRequest(led);
+    }
+
+    const uint8_t channelLevels[NUM_CHANNELS] = {levels->red, levels->green, levels->blue};
+    for (int channel = 0; channel < NUM_CHANNELS; channel++) {
+        channelDuty[ledIndex * NUM_CHANNELS + channel] = gammaTable[channelLevels[channel]];
+    }
+
+    BuildSchedule(&schedules[1 - activeSchedule]);
+    scheduleChanged = true;
+
+    if (!timerRunning) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        StartFrame(&now);
+    }
+    return ArmTimer();
+}
+
+void RgbLedPwm_Release(size_t ledIndex)
+{
+    if (ledIndex >= pwmLedCount) {
+        return;
+    }
+
+    uint32_t ledMask = ((1u << NUM_CHANNELS) - 1) << (ledIndex * NUM_CHANNELS);
+    if ((drivenMask & ledMask) == 0) {
+        return;
+    }
+
+    drivenMask &= ~ledMask;
+    litMask &= ~ledMask;
+    RgbLedUtility_InvalidateColor(pwmLeds[ledIndex]);
+
+    BuildSchedule(&schedules[1 - activeSchedule]);
+    scheduleChanged = true;
+    if (!timerRunning) {
+        StartFrame(&frameStart);
+    }
+    ArmTimer();
+}
+
+bool RgbLedPwm_IsDriving(size_t ledIndex)
+{
+    uint32_t ledMask = ((1u << NUM_CHANNELS) - 1) << (ledIndex * NUM_CHANNELS);
+    return ledIndex < pwmLedCount && (drivenMask & ledMask) != 0;
+}
+
+void RgbLedPwm_Close(void)
+{
+    CloseFdAndPrintError(pwmTimerFd, "PwmTimer");
+    pwmTimerFd = -1;
+    timerRunning = false;
+    drivenMask = 0;
+    pwmLedCount = 0;
+}
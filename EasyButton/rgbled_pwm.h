@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rgbled_utility.h"
+
+/// <summary>
+///     Maximum number of LEDs driven by the PWM engine.
+/// </summary>
+#define RGBLED_PWM_MAX_LEDS 8
+
+/// <summary>
+///     Period of a PWM frame, in nanoseconds (100 Hz).
+/// </summary>
+#define RGBLED_PWM_FRAME_PERIOD_NS 10000000
+
+/// <summary>
+///     8-bit brightness of each channel of an RGB LED, before gamma correction.
+/// </summary>
+typedef RgbLedUtility_Rgb RgbLedPwm_Levels;
+
+/// <summary>
+///     Initializes the PWM engine for the given LEDs, which must already be opened with
+///     RgbLedUtility_OpenLeds. All LEDs share one timer, registered on the given epoll instance.
+///     The engine does not drive a LED until levels are set for it, and its timer only runs
+///     while a channel needs a duty cycle strictly between off and fully on.
+/// </summary>
+/// <param name="epollFd">The epoll instance on which the PWM timer is registered.</param>
+/// <param name="leds">The LEDs the engine can drive.</param>
+/// <param name="ledCount">The number of LEDs.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int RgbLedPwm_Init(int epollFd, RgbLed **leds, size_t ledCount);
+
+/// <summary>
+///     Sets the brightness of each channel of a LED and takes over driving it.
+///     The new levels take effect at the start of the next PWM frame.
+/// </summary>
+/// <param name="ledIndex">Index of the LED in the array given to RgbLedPwm_Init.</param>
+/// <param name="levels">The brightness of each channel.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
+int RgbLedPwm_SetLevels(size_t ledIndex, const RgbLedPwm_Levels *levels);
+
+/// <summary>
+///     Stops driving a LED, so that it can be set again with RgbLedUtility_SetLed.
+/// </summary>
+/// <param name="ledIndex">Index of the LED in the array given to RgbLedPwm_Init.</param>
+void RgbLedPwm_Release(size_t ledIndex);
+
+/// <summary>
+///     Returns whether the engine is driving a LED.
+/// </summary>
+/// <param name="ledIndex">Index of the LED in the array given to RgbLedPwm_Init.</param>
+bool RgbLedPwm_IsDriving(size_t ledIndex);
+
+/// <summary>
+///     Stops the engine and closes its timer. The LEDs are left open.
+/// </summary>
+void RgbLedPwm_Close(void);
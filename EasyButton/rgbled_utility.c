@@ -6,103 +6,434 @@
 
 #include "rgbled_utility.h"
 
-/// <summary>
-///     Maximum number of managed LEDs.
-/// </summary>
-#define MAX_LED_COUNT 4
+#ifdef EASYBUTTON_HOST_BUILD
+#include "gpio_sim.h"
+#endif
 
-static const char *colorNames[] = {"white", "blue",   "cyan",    "green",
-                                   "red",   "yellow", "magenta", "off"};
-static const RgbLedUtility_Colors colors[] = {
-    RgbLedUtility_Colors_White,   RgbLedUtility_Colors_Blue, RgbLedUtility_Colors_Cyan,
-    RgbLedUtility_Colors_Green,   RgbLedUtility_Colors_Red,  RgbLedUtility_Colors_Yellow,
-    RgbLedUtility_Colors_Magenta, RgbLedUtility_Colors_Off};
+// Color names and their lengths, indexed by RgbLedUtility_Colors.
+static const char *colorNames[RgbLedUtility_Colors_Unknown + 1] = {
+    "off", "red", "green", "yellow", "blue", "magenta", "cyan", "white", "unknown"};
+static const size_t colorNameLengths[RgbLedUtility_Colors_Unknown + 1] = {3, 3, 5, 6, 4, 7, 4, 5, 7};
 
-static RgbLed rgbLeds[MAX_LED_COUNT];
-static size_t openedLeds = 0;
+// Registry of the opened LEDs, one array per field, indexed by RgbLed.index.
+static int channelFds[NUM_CHANNELS][RGBLED_MAX_LEDS];
+static RgbLedUtility_Colors writtenColors[RGBLED_MAX_LEDS];
+static RgbLedUtility_Colors requestedColors[RGBLED_MAX_LEDS];
+// One bit per slot: slots in use, and slots with a requested color not yet written.
+static uint32_t openedMask = 0;
+static uint32_t dirtyMask = 0;
+
+/// <summary>
+///     Closes the channels of the registry slots in 'slots', after turning them off.
+/// </summary>
+static void CloseSlotChannels(const int *slots, size_t slotCount)
+{
+    for (size_t i = 0; i < slotCount; i++) {
+        for (int channel = 0; channel < NUM_CHANNELS; channel++) {
+            int ledFd = channelFds[channel][slots[i]];
+            if (ledFd >= 0) {
+                GPIO_SetValue(ledFd, GPIO_Value_High); // off
+                close(ledFd);
+                channelFds[channel][slots[i]] = -1;
+            }
+        }
+    }
+}
 
 int RgbLedUtility_OpenLeds(RgbLed **outLeds, size_t ledCount, const int (*ledGpios)[NUM_CHANNELS])
 {
-    if (ledCount > MAX_LED_COUNT) {
-        Log_Debug("ERROR: Cannot specify more than %d RGB LEDs.\n", MAX_LED_COUNT);
+    // Reserve a free registry slot for each LED.
+    int slots[RGBLED_MAX_LEDS];
+    uint32_t freeMask = ~openedMask;
+    if ((size_t)__builtin_popcount(freeMask) < ledCount) {
+        Log_Debug("ERROR: Cannot open more than %d RGB LEDs.\n", RGBLED_MAX_LEDS);
         return -1;
     }
+    for (size_t i = 0; i < ledCount; i++) {
+        slots[i] = __builtin_ctz(freeMask);
+        freeMask &= freeMask - 1;
+        for (int channel = 0; channel < NUM_CHANNELS; channel++) {
+            channelFds[channel][slots[i]] = -1;
+        }
+    }
 
     for (size_t i = 0; i < ledCount; i++) {
-        Log_Debug("INFO: Open RGB LED %d.\n", i);
+        Log_Debug("INFO: Open RGB LED %d.\n", slots[i]);
         for (int channel = 0; channel < NUM_CHANNELS; channel++) {
-            outLeds[i]->channel[channel] =
+            int ledFd =
                 GPIO_OpenAsOutput(ledGpios[i][channel], GPIO_OutputMode_PushPull, GPIO_Value_High);
-            if (outLeds[i]->channel[channel] < 0) {
+            if (ledFd < 0) {
                 Log_Debug("ERROR: Could not open LED.\n");
+                // Leave no line of this call open, so that it can be retried.
+                CloseSlotChannels(slots, i + 1);
                 return -1;
             }
-
-            // Copy the created handles in the internal rgbLeds struct.
-            // They are needed when converting from a raw LED pointer to an index inside
-            // the rgbLeds structure.
-            rgbLeds[i].channel[channel] = outLeds[i]->channel[channel];
+            channelFds[channel][slots[i]] = ledFd;
         }
     }
 
-    openedLeds = ledCount;
+    for (size_t i = 0; i < ledCount; i++) {
+        int slot = slots[i];
+        openedMask |= 1u << slot;
+        dirtyMask &= ~(1u << slot);
+        // All channels were opened high, which is off.
+        writtenColors[slot] = RgbLedUtility_Colors_Off;
+        requestedColors[slot] = RgbLedUtility_Colors_Unknown;
+        outLeds[i]->index = slot;
+    }
+
     return 0;
 }
 
-int RgbLedUtility_SetLed(const RgbLed *led, RgbLedUtility_Colors colorRequested)
+/// <summary>
+///     Returns whether 'led' refers to an opened registry slot.
+/// </summary>
+static bool IsOpen(const RgbLed *led)
+{
+    return led->index >= 0 && led->index < RGBLED_MAX_LEDS &&
+           (openedMask & (1u << led->index)) != 0;
+}
+
+int RgbLedUtility_GetChannelFd(const RgbLed *led, int channel)
+{
+    return IsOpen(led) ? channelFds[channel][led->index] : -1;
+}
+
+RgbLedUtility_Colors RgbLedUtility_GetColor(const RgbLed *led)
+{
+    return IsOpen(led) ? writtenColors[led->index] : RgbLedUtility_Colors_Unknown;
+}
+
+void RgbLedUtility_InvalidateColor(RgbLed *led)
 {
-    int result;
+    if (IsOpen(led)) {
+        writtenColors[led->index] = RgbLedUtility_Colors_Unknown;
+    }
+}
+
+/// <summary>
+///     Appends to 'fds' and 'values' the channel writes needed to change the LED in 'slot' to the
+///     requested color: only the channels that differ from the last written color, or all of
+///     them if the state of the LED is unknown.
+/// </summary>
+static size_t CollectChannelWrites(int slot, RgbLedUtility_Colors colorRequested, int *fds,
+                                   GPIO_Value_Type *values)
+{
+    size_t writeCount = 0;
+    RgbLedUtility_Colors color = writtenColors[slot];
+    int changedChannels = (color == RgbLedUtility_Colors_Unknown)
+                              ? (1 << NUM_CHANNELS) - 1
+                              : ((int)color ^ (int)colorRequested);
 
     for (int channel = 0; channel < NUM_CHANNELS; channel++) {
+        if ((changedChannels & (0x1 << channel)) == 0) {
+            continue;
+        }
+
         bool isOn = (int)colorRequested & (0x1 << channel);
+        fds[writeCount] = channelFds[channel][slot];
+        values[writeCount] = isOn ? GPIO_Value_Low : GPIO_Value_High;
+        writeCount++;
+    }
 
-        result = GPIO_SetValue(led->channel[channel], isOn ? GPIO_Value_Low : GPIO_Value_High);
-        if (result != 0) {
-            Log_Debug("ERROR: Cannot change RGB LED 0x%x color.\n", led);
+    return writeCount;
+}
+
+/// <summary>
+///     Applies channel writes in one pass.
+/// </summary>
+/// <returns>The number of leading writes that succeeded.</returns>
+static size_t ApplyChannelWrites(const int *fds, const GPIO_Value_Type *values, size_t writeCount)
+{
+#ifdef EASYBUTTON_HOST_BUILD
+    return GpioSim_SetValues(fds, values, writeCount);
+#else
+    for (size_t i = 0; i < writeCount; i++) {
+        if (GPIO_SetValue(fds[i], values[i]) != 0) {
+            return i;
         }
     }
-    return result;
+    return writeCount;
+#endif
 }
 
-void RgbLedUtility_CloseLeds(RgbLed **leds, size_t ledCount)
+/// <summary>
+///     Writes the colors of the LEDs in 'slots' in one pass, and clears their requests.
+/// </summary>
+static int WriteSlots(const int *slots, const RgbLedUtility_Colors *colorsRequested,
+                      size_t slotCount)
 {
+    int fds[RGBLED_MAX_LEDS * NUM_CHANNELS];
+    GPIO_Value_Type values[RGBLED_MAX_LEDS * NUM_CHANNELS];
+    size_t firstWrite[RGBLED_MAX_LEDS + 1];
+    size_t writeCount = 0;
+
+    for (size_t i = 0; i < slotCount; i++) {
+        firstWrite[i] = writeCount;
+        writeCount += CollectChannelWrites(slots[i], colorsRequested[i], fds + writeCount,
+                                           values + writeCount);
+    }
+    firstWrite[slotCount] = writeCount;
+
+    size_t written = ApplyChannelWrites(fds, values, writeCount);
+
+    // After a failed write, the next write of the LED must set all its channels again.
+    for (size_t i = 0; i < slotCount; i++) {
+        dirtyMask &= ~(1u << slots[i]);
+        if (firstWrite[i + 1] <= written) {
+            writtenColors[slots[i]] = colorsRequested[i];
+        } else {
+            Log_Debug("ERROR: Cannot change RGB LED %d color.\n", slots[i]);
+            writtenColors[slots[i]] = RgbLedUtility_Colors_Unknown;
+        }
+    }
+
+    return written == writeCount ? 0 : -1;
+}
+
+int RgbLedUtility_SetLed(RgbLed *led, RgbLedUtility_Colors colorRequested)
+{
+    return RgbLedUtility_SetLeds(&led, &colorRequested, 1);
+}
+
+int RgbLedUtility_SetLeds(RgbLed **leds, const RgbLedUtility_Colors *colorsRequested,
+                          size_t ledCount)
+{
+    if (ledCount > RGBLED_MAX_LEDS) {
+        Log_Debug("ERROR: Cannot set more than %d RGB LEDs at once.\n", RGBLED_MAX_LEDS);
+        return -1;
+    }
+
+    int slots[RGBLED_MAX_LEDS];
     for (size_t i = 0; i < ledCount; i++) {
-        for (int channel = 0; channel < NUM_CHANNELS; channel++) {
-            int ledFd = leds[i]->channel[channel];
-            if (ledFd >= 0) {
-                GPIO_SetValue(ledFd, GPIO_Value_High); // off
-                close(ledFd);
-            }
+        if (!IsOpen(leds[i])) {
+            Log_Debug("ERROR: RGB LED 0x%x is not open.\n", leds[i]);
+            return -1;
         }
+        slots[i] = leds[i]->index;
     }
 
-    openedLeds = 0;
+    return WriteSlots(slots, colorsRequested, ledCount);
+}
+
+void RgbLedUtility_RequestLed(RgbLed *led, RgbLedUtility_Colors color)
+{
+    if (IsOpen(led)) {
+        requestedColors[led->index] = color;
+        dirtyMask |= 1u << led->index;
+    }
+}
+
+void RgbLedUtility_DiscardRequest(RgbLed *led)
+{
+    if (IsOpen(led)) {
+        dirtyMask &= ~(1u << led->index);
+    }
+}
+
+int RgbLedUtility_RenderLeds(void)
+{
+    int slots[RGBLED_MAX_LEDS];
+    RgbLedUtility_Colors colors[RGBLED_MAX_LEDS];
+    size_t dirtyCount = 0;
+
+    for (uint32_t pending = dirtyMask; pending != 0; pending &= pending - 1) {
+        int slot = __builtin_ctz(pending);
+        slots[dirtyCount] = slot;
+        colors[dirtyCount] = requestedColors[slot];
+        dirtyCount++;
+    }
+
+    return dirtyCount == 0 ? 0 : WriteSlots(slots, colors, dirtyCount);
+}
+
+void RgbLedUtility_CloseLeds(RgbLed **leds, size_t ledCount)
+{
+    for (size_t i = 0; i < ledCount; i++) {
+        if (!IsOpen(leds[i])) {
+            continue;
+        }
+
+        int slot = leds[i]->index;
+        CloseSlotChannels(&slot, 1);
+        openedMask &= ~(1u << slot);
+        dirtyMask &= ~(1u << slot);
+        writtenColors[slot] = RgbLedUtility_Colors_Unknown;
+        leds[i]->index = -1;
+    }
 }
 
 RgbLedUtility_Colors RgbLedUtility_GetColorFromString(const char *colorName, size_t colorNameSize)
 {
-    RgbLedUtility_Colors returnedColor = RgbLedUtility_Colors_Unknown;
+    if (colorNameSize == 0) {
+        return RgbLedUtility_Colors_Unknown;
+    }
 
-    for (size_t i = 0; i < sizeof(colors) / sizeof(*colors); i++) {
-        size_t colorNameLength = strlen(colorNames[i]);
-        if ((strncmp(colorNames[i], colorName, colorNameLength) == 0) && /* Same content */
-            (colorNameLength == colorNameSize))                          /* Same length */
-            returnedColor = colors[i];
+    // Every color name starts with a different letter, so the first character selects the only
+    // candidate, which is then confirmed by its length and content.
+    RgbLedUtility_Colors candidate;
+    switch (colorName[0]) {
+    case 'o':
+        candidate = RgbLedUtility_Colors_Off;
+        break;
+    case 'r':
+        candidate = RgbLedUtility_Colors_Red;
+        break;
+    case 'g':
+        candidate = RgbLedUtility_Colors_Green;
+        break;
+    case 'y':
+        candidate = RgbLedUtility_Colors_Yellow;
+        break;
+    case 'b':
+        candidate = RgbLedUtility_Colors_Blue;
+        break;
+    case 'm':
+        candidate = RgbLedUtility_Colors_Magenta;
+        break;
+    case 'c':
+        candidate = RgbLedUtility_Colors_Cyan;
+        break;
+    case 'w':
+        candidate = RgbLedUtility_Colors_White;
+        break;
+    default:
+        return RgbLedUtility_Colors_Unknown;
     }
 
-    return returnedColor;
+    if (colorNameSize != colorNameLengths[candidate] ||
+        memcmp(colorName, colorNames[candidate], colorNameSize) != 0) {
+        return RgbLedUtility_Colors_Unknown;
+    }
+    return candidate;
 }
 
 const char *RgbLedUtility_GetStringFromColor(RgbLedUtility_Colors color)
 {
-    const char *returnedColor = "unknown";
+    if ((unsigned int)color > RgbLedUtility_Colors_Unknown) {
+        return colorNames[RgbLedUtility_Colors_Unknown];
+    }
+    return colorNames[color];
+}
+
+/// <summary>
+///     Parses exactly 'digitCount' hexadecimal digits.
+/// </summary>
+/// <returns>true on success, false if a character is not a hexadecimal digit.</returns>
+static bool ParseHex(const char *string, size_t digitCount, unsigned int *outValue)
+{
+    unsigned int value = 0;
+    for (size_t i = 0; i < digitCount; i++) {
+        char c = string[i];
+        unsigned int digit;
+        if (c >= '0' && c <= '9') {
+            digit = (unsigned int)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            digit = (unsigned int)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            digit = (unsigned int)(c - 'A' + 10);
+        } else {
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
 
-    for (size_t i = 0; i < sizeof(colors) / sizeof(*colors); i++) {
-        if (color == colors[i]) {
-            returnedColor = colorNames[i];
-            break;
+    *outValue = value;
+    return true;
+}
+
+/// <summary>
+///     Parses a decimal number from 0 to 255 at 'string[*position]', skipping surrounding spaces,
+///     and advances 'position' past it.
+/// </summary>
+/// <returns>true on success, false otherwise.</returns>
+static bool ParseChannel(const char *string, size_t size, size_t *position, uint8_t *outValue)
+{
+    size_t i = *position;
+    while (i < size && string[i] == ' ') {
+        i++;
+    }
+
+    unsigned int value = 0;
+    size_t digits = 0;
+    while (i < size && string[i] >= '0' && string[i] <= '9' && digits < 3) {
+        value = value * 10 + (unsigned int)(string[i] - '0');
+        digits++;
+        i++;
+    }
+    while (i < size && string[i] == ' ') {
+        i++;
+    }
+
+    if (digits == 0 || value > 255) {
+        return false;
+    }
+
+    *position = i;
+    *outValue = (uint8_t)value;
+    return true;
+}
+
+bool RgbLedUtility_ParseColor(const char *string, size_t stringSize, RgbLedUtility_Rgb *outRgb)
+{
+    // "#RRGGBB"
+    if (stringSize == 7 && string[0] == '#') {
+        unsigned int value;
+        if (!ParseHex(string + 1, 6, &value)) {
+            return false;
+        }
+        outRgb->red = (uint8_t)(value >> 16);
+        outRgb->green = (uint8_t)(value >> 8);
+        outRgb->blue = (uint8_t)value;
+        return true;
+    }
+
+    // "rgb(r,g,b)"
+    if (stringSize > 5 && memcmp(string, "rgb(", 4) == 0 && string[stringSize - 1] == ')') {
+        size_t position = 4;
+        size_t end = stringSize - 1;
+        uint8_t channels[NUM_CHANNELS];
+        for (int channel = 0; channel < NUM_CHANNELS; channel++) {
+            if (!ParseChannel(string, end, &position, &channels[channel])) {
+                return false;
+            }
+            if (channel < NUM_CHANNELS - 1) {
+                if (position >= end || string[position] != ',') {
+                    return false;
+                }
+                position++;
+            }
         }
+        if (position != end) {
+            return false;
+        }
+        outRgb->red = channels[0];
+        outRgb->green = channels[1];
+        outRgb->blue = channels[2];
+        return true;
+    }
+
+    // Color name.
+    RgbLedUtility_Colors color = RgbLedUtility_GetColorFromString(string, stringSize);
+    if (color == RgbLedUtility_Colors_Unknown) {
+        return false;
     }
+    outRgb->red = (color & RgbLedUtility_Colors_Red) ? 255 : 0;
+    outRgb->green = (color & RgbLedUtility_Colors_Green) ? 255 : 0;
+    outRgb->blue = (color & RgbLedUtility_Colors_Blue) ? 255 : 0;
+    return true;
+}
 
-    return returnedColor;
+RgbLedUtility_Colors RgbLedUtility_GetColorFromRgb(const RgbLedUtility_Rgb *rgb)
+{
+    const uint8_t channelLevels[NUM_CHANNELS] = {rgb->red, rgb->green, rgb->blue};
+    int color = 0;
+    for (int channel = 0; channel < NUM_CHANNELS; channel++) {
+        if (channelLevels[channel] == 255) {
+            color |= 1 << channel;
+        } else if (channelLevels[channel] != 0) {
+            return RgbLedUtility_Colors_Unknown;
+        }
+    }
+    return (RgbLedUtility_Colors)color;
 }
@@ -2,30 +2,12 @@
 
 #include <time.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <applibs/gpio.h>
 
 #define NUM_CHANNELS 3
 
-/// <summary>
-///     Struct representing an RGB LED
-/// </summary>
-typedef struct RgbLed {
-    /// <summary>
-    ///     File descriptors for GPIOs for the red, green and blue color channels comprising the RGB
-    ///     LED
-    /// </summary>
-    int channel[NUM_CHANNELS];
-} RgbLed;
-
-/// <summary>
-///     The init value for RgbLed structs.
-/// </summary>
-#define RGBLED_INIT_VALUE         \
-    {                             \
-        .channel = { -1, -1, -1 } \
-    }
-
 /// <summary>
 ///     Enumeration of available LED colors.
 /// </summary>
@@ -42,33 +24,128 @@ typedef enum {
 } RgbLedUtility_Colors;
 
 /// <summary>
-///     Opens the first 'n' LEDs as defined in the ledGpios array, where n is ledCount, and returns
-///     their file descriptors via the provided 'leds' array.
+///     8-bit level of each channel of an RGB color.
+/// </summary>
+typedef struct RgbLedUtility_Rgb {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+} RgbLedUtility_Rgb;
+
+/// <summary>
+///     Maximum number of LEDs that can be open at the same time, across all calls to
+///     RgbLedUtility_OpenLeds: the four user LEDs, the status and networking LEDs of the board,
+///     and LEDs wired to the headers.
+/// </summary>
+#define RGBLED_MAX_LEDS 32
+
+/// <summary>
+///     Handle of an RGB LED. The channel file descriptors and the color state of the opened
+///     LEDs are kept by the module in per-field arrays indexed by 'index', so that rendering
+///     scans only the compact state of the LEDs it needs.
+/// </summary>
+typedef struct RgbLed {
+    /// <summary>
+    ///     Slot of the LED in the module's registry, or -1 if the LED is not open.
+    /// </summary>
+    int index;
+} RgbLed;
+
+/// <summary>
+///     The init value for RgbLed structs.
+/// </summary>
+#define RGBLED_INIT_VALUE \
+    {                     \
+        .index = -1       \
+    }
+
+/// <summary>
+///     Opens the first 'n' LEDs as defined in the ledGpios array, where n is ledCount, and
+///     returns them via the provided 'outLeds' array. LEDs may be opened by several calls, up to
+///     RGBLED_MAX_LEDS in total. If any channel cannot be opened, the channels already opened
+///     by this call are closed again and none of the LEDs is registered.
 /// </summary>
 /// <param name="outLeds">An array which will be populated by opened RgbLeds.</param>
 /// <param name="ledCount">The number of LEDs to open.</param>
 /// <param name="ledGpios">An array containing the LED GPIO definitions for each channel of the RGB
 /// LEDs to open.</param>
+/// <returns>0 on success, or -1 on failure.</returns>
 int RgbLedUtility_OpenLeds(RgbLed **outLeds, size_t ledCount, const int (*ledGpios)[NUM_CHANNELS]);
 
 /// <summary>
-///     Closes the file descriptors provided in the 'leds' array.
+///     Turns off and closes the LEDs provided in the 'leds' array, freeing their registry slots.
 /// </summary>
 /// <param name="leds">An array of previously opened RgbLeds.</param>
 /// <param name="ledCount">The number of LEDs to close.</param>
 void RgbLedUtility_CloseLeds(RgbLed **leds, size_t ledCount);
 
 /// <summary>
-///     Changes the color of an RGB LED.
+///     Returns the file descriptor of a channel of an opened RGB LED.
+/// </summary>
+/// <param name="led">An opened RgbLed.</param>
+/// <param name="channel">The channel, from 0 (red) to NUM_CHANNELS - 1 (blue).</param>
+/// <returns>The file descriptor, or -1 if the LED is not open.</returns>
+int RgbLedUtility_GetChannelFd(const RgbLed *led, int channel);
+
+/// <summary>
+///     Returns the color last written to an RGB LED, or RgbLedUtility_Colors_Unknown if its
+///     channels are in an unknown state.
+/// </summary>
+/// <param name="led">An opened RgbLed.</param>
+RgbLedUtility_Colors RgbLedUtility_GetColor(const RgbLed *led);
+
+/// <summary>
+///     Marks the channels of an RGB LED as being in an unknown state, for use when they are
+///     written by other means; the next color written sets all of them again.
+/// </summary>
+/// <param name="led">An opened RgbLed.</param>
+void RgbLedUtility_InvalidateColor(RgbLed *led);
+
+/// <summary>
+///     Changes the color of an RGB LED. Only the channels that differ from the color last
+///     written are set, so setting the current color again costs no GPIO writes.
 /// </summary>
 /// <param name="leds">An RgbLed.</param>
 /// <param name="color">The color to change to.</param>
-int RgbLedUtility_SetLed(const RgbLed *led, RgbLedUtility_Colors color);
+/// <returns>0 on success, or -1 if a channel could not be set.</returns>
+int RgbLedUtility_SetLed(RgbLed *led, RgbLedUtility_Colors color);
 
 /// <summary>
-///     Searches in the given string the first occurence of one of the color's name
-///     defined in the RgbLedUtility_Colors enum (e.g. "red" for RgbLedUtility_Colors_Red), and
-///     returns the matching enum.
+///     Changes the color of several RGB LEDs at once. The channel writes needed by all LEDs are
+///     computed first, against the color last written to each LED, and then applied together in
+///     a single pass, so that the LEDs change as close to simultaneously as possible.
+///     Any color requested for these LEDs with RgbLedUtility_RequestLed is discarded.
+/// </summary>
+/// <param name="leds">An array of RgbLeds.</param>
+/// <param name="colors">The color to change each LED to.</param>
+/// <param name="ledCount">The number of LEDs to change.</param>
+/// <returns>0 on success, or -1 if a channel could not be set.</returns>
+int RgbLedUtility_SetLeds(RgbLed **leds, const RgbLedUtility_Colors *colors, size_t ledCount);
+
+/// <summary>
+///     Requests the color of an RGB LED without writing it. Only the last color requested for
+///     a LED before the next RgbLedUtility_RenderLeds is written.
+/// </summary>
+/// <param name="led">An opened RgbLed.</param>
+/// <param name="color">The color to change to.</param>
+void RgbLedUtility_RequestLed(RgbLed *led, RgbLedUtility_Colors color);
+
+/// <summary>
+///     Discards the color requested for an RGB LED, if any.
+/// </summary>
+/// <param name="led">An opened RgbLed.</param>
+void RgbLedUtility_DiscardRequest(RgbLed *led);
+
+/// <summary>
+///     Writes the colors requested for the opened LEDs since the last render, in one batch.
+///     Call it once all the handlers of a batch of events have run.
+/// </summary>
+/// <returns>0 on success, or -1 if a channel could not be set.</returns>
+int RgbLedUtility_RenderLeds(void);
+
+/// <summary>
+///     Returns the color defined in the RgbLedUtility_Colors enum whose name is the given string
+///     (e.g. "red" for RgbLedUtility_Colors_Red).
 ///     If no matching color is found, <see cref="RgbLedUtility_Colors_Unknown"/> is returned.
 /// </summary>
 /// <param name="string">string searched for a word indicating a color</param>
@@ -84,3 +161,21 @@ RgbLedUtility_Colors RgbLedUtility_GetColorFromString(const char *string, size_t
 /// <param name="color">The color enum to get the string representation of.</param>
 /// <returns>The relative color string representation. </returns>
 const char *RgbLedUtility_GetStringFromColor(RgbLedUtility_Colors color);
+
+/// <summary>
+///     Parses a color given either by name (see RgbLedUtility_GetColorFromString), as "#RRGGBB"
+///     hexadecimal, or as "rgb(r,g,b)" with decimal channels from 0 to 255.
+/// </summary>
+/// <param name="string">The color string; it does not need to be null terminated.</param>
+/// <param name="stringSize">The size of the string.</param>
+/// <param name="outRgb">Receives the parsed color.</param>
+/// <returns>true if the string is a valid color, false otherwise.</returns>
+bool RgbLedUtility_ParseColor(const char *string, size_t stringSize, RgbLedUtility_Rgb *outRgb);
+
+/// <summary>
+///     Returns the RgbLedUtility_Colors matching an RGB color whose channels are each either off
+///     or fully on, or <see cref="RgbLedUtility_Colors_Unknown"/> otherwise.
+/// </summary>
+/// <param name="rgb">The RGB color.</param>
+/// <returns>The matching color's enum.</returns>
+RgbLedUtility_Colors RgbLedUtility_GetColorFromRgb(const RgbLedUtility_Rgb *rgb);